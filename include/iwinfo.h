@@ -20,8 +20,12 @@
 #include <errno.h>
 
 
-#define IWINFO_BUFSIZE	24 * 1024
+/* size of the result buffers passed in by callers; 24k before the per-AC
+   assoclist statistics, callers built against older headers must be
+   rebuilt along with the changed entry layouts */
+#define IWINFO_BUFSIZE	64 * 1024
 #define IWINFO_ESSID_MAX_SIZE	32
+#define IWINFO_MAX_CHAINS	4
 
 enum iwinfo_80211 {
 	IWINFO_80211_A = 0,
@@ -49,6 +53,19 @@ enum iwinfo_80211 {
 extern const char * const IWINFO_80211_NAMES[IWINFO_80211_COUNT];
 
 
+enum iwinfo_ac {
+	IWINFO_AC_BE = 0,
+	IWINFO_AC_BK,
+	IWINFO_AC_VI,
+	IWINFO_AC_VO,
+
+	/* keep last */
+	IWINFO_AC_COUNT
+};
+
+extern const char * const IWINFO_AC_NAMES[IWINFO_AC_COUNT];
+
+
 enum iwinfo_band {
 	IWINFO_BAND_24 = 0,
 	IWINFO_BAND_5,
@@ -245,6 +262,27 @@ struct iwinfo_rate_entry {
 	uint8_t eht_gi;
 };
 
+struct iwinfo_txq_stats {
+	uint32_t backlog_bytes;
+	uint32_t backlog_packets;
+	uint32_t flows;
+	uint32_t drops;
+	uint32_t ecn_marks;
+	uint32_t overlimit;
+	uint32_t overmemory;
+	uint32_t collisions;
+	uint32_t tx_bytes;
+	uint32_t tx_packets;
+};
+
+struct iwinfo_ac_stats {
+	uint64_t rx_msdu;
+	uint64_t tx_msdu;
+	uint64_t tx_msdu_retries;
+	uint64_t tx_msdu_failed;
+	struct iwinfo_txq_stats txq;
+};
+
 struct iwinfo_assoclist_entry {
 	uint8_t	mac[6];
 	int8_t signal;
@@ -275,6 +313,70 @@ struct iwinfo_assoclist_entry {
 	char local_ps[16];
 	char peer_ps[16];
 	char nonpeer_ps[16];
+	char ifname[IFNAMSIZ];
+	/* bitmasks of the chains with a value, indexed by chain number */
+	uint8_t chains;
+	uint8_t chains_avg;
+	int8_t chain_signal[IWINFO_MAX_CHAINS];
+	int8_t chain_signal_avg[IWINFO_MAX_CHAINS];
+	uint64_t rx_duration;
+	uint64_t tx_duration;
+	uint16_t airtime_weight;
+	uint32_t rx_mpdus;
+	uint32_t fcs_errors;
+	uint32_t beacon_loss;
+	uint64_t beacon_rx;
+	int8_t beacon_signal_avg;
+	int8_t ack_signal;
+	int8_t ack_signal_avg;
+	struct iwinfo_ac_stats ac[IWINFO_AC_COUNT];
+};
+
+struct iwinfo_assoclist_delta {
+	uint8_t mac[6];
+	uint32_t interval;
+	uint64_t rx_bytes;
+	uint64_t tx_bytes;
+	uint32_t rx_packets;
+	uint32_t tx_packets;
+	uint32_t tx_retries;
+	uint32_t tx_failed;
+	uint64_t rx_duration;
+	uint64_t tx_duration;
+	uint16_t airtime_weight;
+	/* permille of the interval resp. of the summed station airtime */
+	uint16_t airtime;
+	uint16_t airtime_share;
+	uint32_t rx_mpdus;
+	uint32_t fcs_errors;
+	uint32_t beacon_loss;
+	uint64_t beacon_rx;
+	/* permille of received resp. attempted MPDUs */
+	uint16_t rx_per;
+	uint16_t tx_per;
+	/* beacon loss events per hour */
+	uint32_t beacon_loss_rate;
+	/* txq backlog is the current value, not a delta */
+	struct iwinfo_ac_stats ac[IWINFO_AC_COUNT];
+};
+
+struct iwinfo_chain_stats {
+	uint16_t stations;
+	/* bitmask of the chains with an offset */
+	uint8_t chains;
+	int8_t offset[IWINFO_MAX_CHAINS];
+	uint8_t imbalance;
+};
+
+struct iwinfo_link_summary {
+	uint16_t stations;
+	uint16_t rx_per;
+	uint16_t tx_per;
+	uint32_t beacon_loss;
+	uint16_t worst_rx_per;
+	uint16_t worst_tx_per;
+	uint8_t worst_rx_mac[6];
+	uint8_t worst_tx_mac[6];
 };
 
 struct iwinfo_survey_entry {
@@ -283,8 +385,18 @@ struct iwinfo_survey_entry {
 	uint64_t busy_time_ext;
 	uint64_t rxtime;
 	uint64_t txtime;
+	/* 0 for the radio totals */
 	uint32_t mhz;
 	uint8_t noise;
+	uint8_t in_use;
+};
+
+enum iwinfo_survey_mode {
+	IWINFO_SURVEY_ALL,
+	/* operating channel only */
+	IWINFO_SURVEY_IN_USE,
+	/* a single entry summing up all channels */
+	IWINFO_SURVEY_RADIO,
 };
 
 struct iwinfo_txpwrlist_entry {
@@ -321,6 +433,35 @@ struct iwinfo_scanlist_vht_chan_entry {
 	uint8_t center_chan_2;
 };
 
+/* BSS Load element, channel utilisation is the busy fraction scaled to
+ * 255 and admission capacity is given in units of 32 us per second */
+struct iwinfo_scanlist_load_entry {
+	uint8_t present;
+	uint8_t chan_util;
+	uint16_t sta_count;
+	uint16_t admission_cap;
+};
+
+/* bss_color is 0 if disabled, the channel fields come from the 6 GHz
+ * operation information and are 0 without it */
+struct iwinfo_scanlist_he_chan_entry {
+	uint8_t present;
+	uint8_t bss_color;
+	uint8_t primary_chan;
+	uint8_t chan_width;
+	uint8_t center_chan_1;
+	uint8_t center_chan_2;
+};
+
+/* the channel fields are 0 without EHT operation information */
+struct iwinfo_scanlist_eht_chan_entry {
+	uint8_t present;
+	uint8_t chan_width;
+	uint8_t center_chan_1;
+	uint8_t center_chan_2;
+	uint16_t disabled_subchans;
+};
+
 extern const char * const ht_secondary_offset[4];
 /* 0 = 20 MHz
    1 = 40 MHz or higher (refer to vht if supported) */
@@ -330,6 +471,17 @@ extern const uint16_t ht_chan_width[2];
    2 = 160 MHz
    3 = 80+80 MHz */
 extern const uint16_t vht_chan_width[4];
+/* 0 = 20 MHz
+   1 = 40 MHz
+   2 = 80 MHz
+   3 = 160 or 80+80 MHz */
+extern const uint16_t he_chan_width[4];
+/* 0 = 20 MHz
+   1 = 40 MHz
+   2 = 80 MHz
+   3 = 160 MHz
+   4 = 320 MHz */
+extern const uint16_t eht_chan_width[5];
 
 struct iwinfo_scanlist_entry {
 	uint8_t mac[6];
@@ -344,8 +496,106 @@ struct iwinfo_scanlist_entry {
 	struct iwinfo_crypto_entry crypto;
 	struct iwinfo_scanlist_ht_chan_entry ht_chan_info;
 	struct iwinfo_scanlist_vht_chan_entry vht_chan_info;
+	/* ms since the BSS was last seen, 0 if unknown */
+	uint32_t age;
+	struct iwinfo_scanlist_load_entry load;
+	struct iwinfo_scanlist_he_chan_entry he_chan_info;
+	struct iwinfo_scanlist_eht_chan_entry eht_chan_info;
+	/* Multiple BSSID index of a nontransmitted BSS, 0 otherwise; derived
+	 * entries were expanded from the beacon of the transmitting BSS */
+	uint8_t mbssid_index;
+	uint8_t mbssid_derived;
+};
+
+#define IWINFO_SCAN_MAX_FREQS	64
+#define IWINFO_SCAN_MAX_SSIDS	4
+
+#define IWINFO_SCAN_F_PASSIVE		(1 << 0)
+#define IWINFO_SCAN_F_LOW_PRIORITY	(1 << 1)
+#define IWINFO_SCAN_F_LOW_SPAN		(1 << 2)
+#define IWINFO_SCAN_F_FLUSH		(1 << 3)
+/* scan 2.4/5 GHz first, then only the 6 GHz channels advertised in
+ * Reduced Neighbor Reports plus the preferred scanning channels */
+#define IWINFO_SCAN_F_RNR_6GHZ		(1 << 4)
+
+#define IWINFO_SCAN_CRYPTO_OPEN		(1 << 0)
+#define IWINFO_SCAN_CRYPTO_WEP		(1 << 1)
+#define IWINFO_SCAN_CRYPTO_WPA		(1 << 2)
+#define IWINFO_SCAN_CRYPTO_WPA2		(1 << 3)
+#define IWINFO_SCAN_CRYPTO_WPA3		(1 << 4)
+
+/* result filter, checked while parsing so rejected BSSes are never stored;
+ * zero fields match everything */
+struct iwinfo_scan_filter {
+	char ssid[IWINFO_ESSID_MAX_SIZE+1];
+	/* IWINFO_BAND_* mask */
+	uint8_t bands;
+	uint8_t channel;
+	/* dBm */
+	int8_t min_signal;
+	/* IWINFO_SCAN_CRYPTO_* mask, any of them matches */
+	uint8_t crypto;
+	/* keep only the top strongest BSSes, sorted by signal */
+	uint16_t top;
+};
+
+struct iwinfo_scan_opts {
+	uint32_t flags;
+	/* dwell time per channel in TU, 0 for the driver default */
+	uint16_t dwell;
+	uint8_t n_freqs;
+	uint8_t n_ssids;
+	uint16_t freqs[IWINFO_SCAN_MAX_FREQS];
+	char ssids[IWINFO_SCAN_MAX_SSIDS][IWINFO_ESSID_MAX_SIZE+1];
+	struct iwinfo_scan_filter filter;
+};
+
+#define IWINFO_SCHED_SCAN_MAX_MATCHES	8
+#define IWINFO_SCHED_SCAN_MAX_PLANS	4
+
+struct iwinfo_sched_scan_match {
+	/* empty matches any SSID */
+	char ssid[IWINFO_ESSID_MAX_SIZE+1];
+	/* dBm, 0 for no threshold */
+	int8_t rssi;
+};
+
+struct iwinfo_sched_scan_plan {
+	/* seconds between scans */
+	uint32_t interval;
+	/* 0 on the last plan, it runs until stopped */
+	uint32_t iterations;
+};
+
+struct iwinfo_sched_scan_opts {
+	struct iwinfo_scan_opts scan;
+	/* seconds before the first scan */
+	uint32_t delay;
+	/* dBm, applies to all match sets without a threshold of their own */
+	int8_t min_rssi;
+	uint8_t n_matches;
+	uint8_t n_plans;
+	struct iwinfo_sched_scan_match matches[IWINFO_SCHED_SCAN_MAX_MATCHES];
+	struct iwinfo_sched_scan_plan plans[IWINFO_SCHED_SCAN_MAX_PLANS];
+};
+
+enum iwinfo_scan_method {
+	IWINFO_SCAN_METHOD_UNKNOWN = 0,
+	IWINFO_SCAN_METHOD_WPA_SUPPLICANT,
+	IWINFO_SCAN_METHOD_DIRECT,
+	IWINFO_SCAN_METHOD_AP,
+	IWINFO_SCAN_METHOD_TMP_IFACE,
+	IWINFO_SCAN_METHOD_AP_DOWN,
+
+	/* keep last */
+	IWINFO_SCAN_METHOD_COUNT
 };
 
+extern const char * const IWINFO_SCAN_METHOD_NAMES[IWINFO_SCAN_METHOD_COUNT];
+
+/* handle of a scan running in the background, see scan_start() */
+struct iwinfo_scan;
+
 struct iwinfo_country_entry {
 	uint16_t iso3166;
 	char ccode[4];
@@ -378,6 +628,18 @@ struct iwinfo_hardware_entry {
 
 extern const struct iwinfo_iso3166_label IWINFO_ISO3166_NAMES[];
 
+struct iwinfo_tunables {
+	/* max. age in ms of the survey sample whose noise value is stamped
+	   into assoclist entries, 0 disables caching */
+	uint32_t noise_cache_ms;
+	/* ms a temporary madwifi VAP created for scanning is kept down for
+	   reuse after its last scan, 0 (default) removes it right away; an
+	   expired VAP is only removed on the next madwifi call or on close */
+	uint32_t madwifi_vap_idle_ms;
+};
+
+extern struct iwinfo_tunables iwinfo_tunables;
+
 #define IWINFO_HARDWARE_FILE	"/usr/share/libiwinfo/devices.txt"
 
 
@@ -412,9 +674,22 @@ struct iwinfo_ops {
 	int (*assoclist)(const char *, char *, int *);
 	int (*txpwrlist)(const char *, char *, int *);
 	int (*scanlist)(const char *, char *, int *);
+	int (*scan)(const char *, const struct iwinfo_scan_opts *, char *, int *);
+	int (*scan_results)(const char *, uint32_t, char *, int *);
+	int (*scan_start)(const char *, const struct iwinfo_scan_opts *,
+	                  struct iwinfo_scan **);
+	int (*scan_fd)(const struct iwinfo_scan *);
+	int (*scan_collect)(struct iwinfo_scan *, char *, int *);
+	void (*scan_abort)(struct iwinfo_scan *);
+	int (*scan_method)(const char *, int *);
+	int (*sched_scan_start)(const char *, const struct iwinfo_sched_scan_opts *,
+	                        struct iwinfo_scan **);
+	int (*sched_scan_stop)(const char *);
 	int (*freqlist)(const char *, char *, int *);
 	int (*countrylist)(const char *, char *, int *);
 	int (*survey)(const char *, char *, int *);
+	int (*survey_mode)(const char *, int, char *, int *);
+	int (*txq_stats)(const char *, struct iwinfo_txq_stats *);
 	int (*lookup_phy)(const char *, char *);
 	int (*phy_path)(const char *phyname, const char **path);
 	void (*close)(void);
@@ -32,6 +32,9 @@
 
 int iwinfo_ioctl(int cmd, void *ifr);
 
+uint64_t iwinfo_msec(void);
+int iwinfo_wait_fd(int fd, uint64_t deadline);
+
 int iwinfo_dbm2mw(int in);
 int iwinfo_mw2dbm(int in);
 static inline int iwinfo_mbm2dbm(int gain)
@@ -61,7 +64,315 @@ struct iwinfo_hardware_entry * iwinfo_hardware(struct iwinfo_hardware_id *id);
 
 int iwinfo_hardware_id_from_mtd(struct iwinfo_hardware_id *id);
 
-void iwinfo_parse_rsn(struct iwinfo_crypto_entry *c, uint8_t *data, uint8_t len,
+void iwinfo_txq_delta(const struct iwinfo_txq_stats *prev,
+                      const struct iwinfo_txq_stats *cur,
+                      struct iwinfo_txq_stats *d);
+
+int iwinfo_assoclist_delta(const char *prev, int prev_len,
+                           const char *cur, int cur_len,
+                           uint32_t interval, char *buf, int *len);
+
+int iwinfo_link_summary(const char *buf, int len,
+                        struct iwinfo_link_summary *st);
+
+int iwinfo_chain_imbalance(const char *buf, int len,
+                           struct iwinfo_chain_stats *st);
+
+void iwinfo_parse_rsn(struct iwinfo_crypto_entry *c, const uint8_t *data, uint8_t len,
 					  uint16_t defcipher, uint8_t defauth);
 
+/*
+ * Zero-copy view of the information elements of a beacon or probe
+ * response. Entries point at the element body, after the extension ID
+ * for extended elements, and are only valid if their bit in present is
+ * set, use iwinfo_ie_get() to access them.
+ */
+enum iwinfo_ie_kind {
+	IWINFO_IE_SSID,
+	IWINFO_IE_MESH_ID,
+	IWINFO_IE_RSN,
+	IWINFO_IE_WPA,
+	IWINFO_IE_HT_OP,
+	IWINFO_IE_VHT_OP,
+	IWINFO_IE_HE_OP,
+	IWINFO_IE_EHT_OP,
+	IWINFO_IE_BSS_LOAD,
+	IWINFO_IE_EXT_CAP,
+	/* first Multiple BSSID element */
+	IWINFO_IE_MBSSID,
+	/* first Reduced Neighbor Report element */
+	IWINFO_IE_RNR,
+	/* elements of a nontransmitted BSSID profile */
+	IWINFO_IE_NONTX_CAP,
+	IWINFO_IE_MBSSID_INDEX,
+	IWINFO_IE_NON_INHERIT,
+
+	/* keep last */
+	IWINFO_IE_COUNT,
+};
+
+struct iwinfo_ie {
+	const uint8_t *data;
+	uint8_t len;
+};
+
+struct iwinfo_ie_view {
+	uint32_t present;
+	uint8_t n_mbssid;
+	uint8_t n_rnr;
+	const uint8_t *raw;
+	int raw_len;
+	struct iwinfo_ie ie[IWINFO_IE_COUNT];
+};
+
+/* one Neighbor AP Information field of a Reduced Neighbor Report */
+struct iwinfo_rnr_ap {
+	uint8_t op_class;
+	uint8_t channel;
+	uint32_t mhz;
+};
+
+static inline const struct iwinfo_ie *
+iwinfo_ie_get(const struct iwinfo_ie_view *v, enum iwinfo_ie_kind kind)
+{
+	return (v->present & (1 << kind)) ? &v->ie[kind] : NULL;
+}
+
+int iwinfo_ie_parse(const uint8_t *ie, int len, struct iwinfo_ie_view *v);
+int iwinfo_ie_next(const struct iwinfo_ie_view *v, uint8_t id,
+                   struct iwinfo_ie *it);
+int iwinfo_ie_rnr(const struct iwinfo_ie_view *v,
+                  struct iwinfo_rnr_ap *aps, int max);
+int iwinfo_ie_mbssid(const struct iwinfo_ie_view *v,
+                     const struct iwinfo_scanlist_entry *tx,
+                     struct iwinfo_scanlist_entry *out, int max);
+int iwinfo_scanlist_dedup(char *buf, int len);
+
+int iwinfo_scan_filter_match(const struct iwinfo_scan_filter *f,
+                             const struct iwinfo_scanlist_entry *e);
+int iwinfo_scanlist_select(struct iwinfo_scanlist_entry *list, int n,
+                           const struct iwinfo_scan_filter *f, int count);
+void iwinfo_scanlist_sort(char *buf, int len);
+int iwinfo_scanlist_filter(char *buf, int len,
+                           const struct iwinfo_scan_filter *f);
+void iwinfo_ie_fill(const struct iwinfo_ie_view *v,
+                    struct iwinfo_scanlist_entry *e);
+
+/*
+ * MAC address index over a flat result list as returned by the assoclist
+ * and scanlist operations. Entries must carry the 6 byte address at offset
+ * zero, size is the entry stride. The index refers into buf, which has to
+ * outlive it.
+ */
+struct iwinfo_macindex {
+	const char *buf;
+	int size;
+	uint32_t mask;
+	int32_t *slots;
+};
+
+static inline uint32_t iwinfo_machash(const uint8_t *mac, uint32_t mask)
+{
+	uint64_t k = ((uint64_t)mac[0] << 40) | ((uint64_t)mac[1] << 32) |
+	             ((uint64_t)mac[2] << 24) | ((uint64_t)mac[3] << 16) |
+	             ((uint64_t)mac[4] <<  8) |  (uint64_t)mac[5];
+
+	/* Fibonacci hashing, the high bits are the best mixed ones */
+	return (uint32_t)((k * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+int iwinfo_macindex_build(struct iwinfo_macindex *idx,
+                          const char *buf, int len, int size);
+void * iwinfo_macindex_lookup(const struct iwinfo_macindex *idx,
+                              const uint8_t *mac);
+void iwinfo_macindex_free(struct iwinfo_macindex *idx);
+
+/*
+ * BSS table, merging scan results by BSSID across scans. Every merge
+ * starts a new generation; entries carry the generation of their last
+ * event so callers can ask for what happened since a generation they
+ * have seen. BSSes not seen for max_age ms are marked gone and kept for
+ * keep_gone further generations before they are dropped.
+ */
+#define IWINFO_BSS_HISTORY		8
+#define IWINFO_BSS_SIGNAL_DELTA		5
+#define IWINFO_BSS_KEEP_GONE		16
+
+enum iwinfo_bss_change {
+	IWINFO_BSS_NEW = 1,
+	IWINFO_BSS_CHANGED,
+	IWINFO_BSS_GONE,
+};
+
+struct iwinfo_bss {
+	struct iwinfo_scanlist_entry e;
+	uint64_t last_seen;
+	uint32_t first_gen;
+	uint32_t gen;
+	uint32_t gone_gen;
+	int8_t ref_signal;
+	uint8_t hist_len;
+	uint8_t hist_pos;
+	int8_t history[IWINFO_BSS_HISTORY];
+	/* change list, oldest event first */
+	int32_t prev;
+	int32_t next;
+};
+
+struct iwinfo_bss_table {
+	struct iwinfo_bss *bss;
+	int count;
+	int size;
+	uint32_t mask;
+	int32_t *slots;
+	int32_t head;
+	int32_t tail;
+	uint32_t generation;
+	uint32_t max_age;
+	uint32_t keep_gone;
+};
+
+int iwinfo_bss_table_init(struct iwinfo_bss_table *t, uint32_t max_age);
+int iwinfo_bss_table_merge(struct iwinfo_bss_table *t, const char *buf, int len);
+const struct iwinfo_bss * iwinfo_bss_table_lookup(const struct iwinfo_bss_table *t,
+                                                  const uint8_t *mac);
+const struct iwinfo_bss * iwinfo_bss_table_changes(const struct iwinfo_bss_table *t,
+                                                   uint32_t since, int *iter,
+                                                   int *change);
+int iwinfo_bss_signal_history(const struct iwinfo_bss *b, int8_t *buf);
+void iwinfo_bss_table_free(struct iwinfo_bss_table *t);
+
+/*
+ * Survey sampler, turning the cumulative per channel survey counters of a
+ * radio into per interval samples. Every update is diffed against the
+ * counters of the previous one, the last IWINFO_SURVEY_HISTORY samples of
+ * each channel are kept. Channels the radio did not spend time on during
+ * an interval, like off-channel ones outside of scans, get no sample.
+ * Radio totals are kept as a channel with mhz 0.
+ */
+#define IWINFO_SURVEY_HISTORY		16
+
+struct iwinfo_survey_sample {
+	/* iwinfo_msec() of the update */
+	uint64_t stamp;
+	/* ms on channel during the interval */
+	uint32_t active;
+	/* permille of the active time */
+	uint16_t busy;
+	uint16_t busy_ext;
+	uint16_t rx;
+	uint16_t tx;
+	/* busy, but neither receiving nor transmitting */
+	uint16_t other;
+	/* dBm, 0 if unknown */
+	int8_t noise;
+};
+
+struct iwinfo_survey_channel {
+	uint32_t mhz;
+	/* counters of the previous update */
+	struct iwinfo_survey_entry last;
+	uint8_t hist_len;
+	uint8_t hist_pos;
+	struct iwinfo_survey_sample history[IWINFO_SURVEY_HISTORY];
+};
+
+struct iwinfo_survey_sampler {
+	struct iwinfo_survey_channel *chan;
+	int count;
+	int size;
+	uint64_t stamp;
+};
+
+int iwinfo_survey_sampler_init(struct iwinfo_survey_sampler *s);
+int iwinfo_survey_sampler_update(struct iwinfo_survey_sampler *s,
+                                 const char *buf, int len);
+const struct iwinfo_survey_channel *
+iwinfo_survey_sampler_lookup(const struct iwinfo_survey_sampler *s,
+                             uint32_t mhz);
+const struct iwinfo_survey_sample *
+iwinfo_survey_latest(const struct iwinfo_survey_channel *c);
+int iwinfo_survey_history(const struct iwinfo_survey_channel *c,
+                          struct iwinfo_survey_sample *buf);
+void iwinfo_survey_sampler_free(struct iwinfo_survey_sampler *s);
+
+/*
+ * Channel ranking, joining the frequency table of a radio with survey
+ * samples and scan results into scored candidates of primary channel and
+ * bandwidth. Inputs are fed as they arrive; only channels whose inputs
+ * changed are marked dirty and only candidates covering a dirty channel
+ * are rescored by iwinfo_chanrank_rank().
+ *
+ * The score is the bandwidth left after the utilisation, neighbour BSS
+ * and noise penalties, all in permille, were taken off in turn.
+ */
+#define IWINFO_RANK_MAX_CHANNELS	128
+#define IWINFO_RANK_MAX_MEMBERS		16
+
+enum iwinfo_rank_util_source {
+	IWINFO_RANK_UTIL_NONE,
+	IWINFO_RANK_UTIL_SURVEY,
+	IWINFO_RANK_UTIL_BSS_LOAD,
+};
+
+struct iwinfo_rank_channel {
+	uint32_t mhz;
+	uint8_t band;
+	uint8_t channel;
+	uint32_t flags;
+	/* survey: smoothed busy time not caused by ourselves, permille */
+	uint16_t busy;
+	int8_t noise;
+	uint8_t have_survey;
+	uint64_t survey_stamp;
+	/* scan: signal weighted BSS pressure with the primary resp. only
+	 * some other part of their channel here, highest BSS Load seen */
+	uint16_t bss_primary;
+	uint16_t bss_overlap;
+	uint16_t bss_load;
+	uint8_t dirty;
+};
+
+struct iwinfo_rank_score {
+	/* permille penalties */
+	uint16_t util;
+	uint16_t bss;
+	uint16_t noise;
+	uint8_t util_source;
+	/* usable bandwidth in 0.1 MHz */
+	uint32_t total;
+};
+
+struct iwinfo_rank_candidate {
+	uint32_t mhz;
+	uint32_t center;
+	uint16_t width;
+	uint8_t band;
+	uint8_t channel;
+	uint8_t n_members;
+	/* channel table indices, the primary first */
+	uint8_t member[IWINFO_RANK_MAX_MEMBERS];
+	struct iwinfo_rank_score score;
+};
+
+struct iwinfo_chanrank {
+	struct iwinfo_rank_channel chan[IWINFO_RANK_MAX_CHANNELS];
+	int count;
+	uint16_t max_width;
+	struct iwinfo_rank_candidate *cand;
+	int n_cand;
+	int size;
+	/* candidates were rescored since the last sort */
+	int unsorted;
+};
+
+int iwinfo_chanrank_init(struct iwinfo_chanrank *r, uint16_t max_width);
+int iwinfo_chanrank_freqlist(struct iwinfo_chanrank *r,
+                             const char *buf, int len);
+int iwinfo_chanrank_survey(struct iwinfo_chanrank *r,
+                           const struct iwinfo_survey_sampler *s);
+int iwinfo_chanrank_scan(struct iwinfo_chanrank *r, const char *buf, int len);
+int iwinfo_chanrank_rank(struct iwinfo_chanrank *r);
+void iwinfo_chanrank_free(struct iwinfo_chanrank *r);
+
 #endif
@@ -0,0 +1,375 @@
+/*
+ * iwinfo - Wireless Information Library - BSS table
+ *
+ * The iwinfo library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * The iwinfo library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with the iwinfo library. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include "iwinfo/utils.h"
+
+
+static int iwinfo_bss_find(const struct iwinfo_bss_table *t, const uint8_t *mac)
+{
+	uint32_t h;
+
+	if (!t->slots)
+		return -1;
+
+	for (h = iwinfo_machash(mac, t->mask); t->slots[h];
+	     h = (h + 1) & t->mask)
+	{
+		if (!memcmp(t->bss[t->slots[h] - 1].e.mac, mac, 6))
+			return t->slots[h] - 1;
+	}
+
+	return -1;
+}
+
+/* slots hold entry index + 1, the table stays at most half full */
+static int iwinfo_bss_rehash(struct iwinfo_bss_table *t, int count)
+{
+	int i;
+	uint32_t h, n = 8;
+	int32_t *slots;
+
+	while (n < (uint32_t)count * 2)
+		n <<= 1;
+
+	if (!(slots = calloc(n, sizeof(*slots))))
+		return -1;
+
+	free(t->slots);
+
+	t->slots = slots;
+	t->mask = n - 1;
+
+	for (i = 0; i < t->count; i++)
+	{
+		for (h = iwinfo_machash(t->bss[i].e.mac, t->mask); t->slots[h];
+		     h = (h + 1) & t->mask);
+
+		t->slots[h] = i + 1;
+	}
+
+	return 0;
+}
+
+static void iwinfo_bss_unlink(struct iwinfo_bss_table *t, int i)
+{
+	struct iwinfo_bss *b = &t->bss[i];
+
+	if (b->prev >= 0)
+		t->bss[b->prev].next = b->next;
+	else
+		t->head = b->next;
+
+	if (b->next >= 0)
+		t->bss[b->next].prev = b->prev;
+	else
+		t->tail = b->prev;
+
+	b->prev = b->next = -1;
+}
+
+static void iwinfo_bss_append(struct iwinfo_bss_table *t, int i)
+{
+	struct iwinfo_bss *b = &t->bss[i];
+
+	b->prev = t->tail;
+	b->next = -1;
+
+	if (t->tail >= 0)
+		t->bss[t->tail].next = i;
+	else
+		t->head = i;
+
+	t->tail = i;
+}
+
+/* record an event, the change list stays sorted by generation */
+static void iwinfo_bss_touch(struct iwinfo_bss_table *t, int i)
+{
+	struct iwinfo_bss *b = &t->bss[i];
+
+	b->gen = t->generation;
+	b->ref_signal = (int8_t)b->e.signal;
+
+	iwinfo_bss_unlink(t, i);
+	iwinfo_bss_append(t, i);
+}
+
+static int iwinfo_bss_changed(const struct iwinfo_bss *b,
+                              const struct iwinfo_scanlist_entry *e)
+{
+	int delta = (int8_t)e->signal - b->ref_signal;
+
+	return (strcmp(b->e.ssid, e->ssid) ||
+	        b->e.mhz != e->mhz ||
+	        b->e.mode != e->mode ||
+	        memcmp(&b->e.crypto, &e->crypto, sizeof(e->crypto)) ||
+	        memcmp(&b->e.ht_chan_info, &e->ht_chan_info,
+	               sizeof(e->ht_chan_info)) ||
+	        memcmp(&b->e.vht_chan_info, &e->vht_chan_info,
+	               sizeof(e->vht_chan_info)) ||
+	        memcmp(&b->e.he_chan_info, &e->he_chan_info,
+	               sizeof(e->he_chan_info)) ||
+	        memcmp(&b->e.eht_chan_info, &e->eht_chan_info,
+	               sizeof(e->eht_chan_info)) ||
+	        delta >= IWINFO_BSS_SIGNAL_DELTA ||
+	        delta <= -IWINFO_BSS_SIGNAL_DELTA);
+}
+
+static void iwinfo_bss_history_push(struct iwinfo_bss *b, int8_t signal)
+{
+	b->history[b->hist_pos] = signal;
+	b->hist_pos = (b->hist_pos + 1) % IWINFO_BSS_HISTORY;
+
+	if (b->hist_len < IWINFO_BSS_HISTORY)
+		b->hist_len++;
+}
+
+static int iwinfo_bss_add(struct iwinfo_bss_table *t,
+                          const struct iwinfo_scanlist_entry *e)
+{
+	struct iwinfo_bss *bss;
+	uint32_t h;
+	int size;
+
+	if (t->count == t->size)
+	{
+		size = t->size ? t->size * 2 : 32;
+
+		if (!(bss = realloc(t->bss, size * sizeof(*bss))))
+			return -1;
+
+		t->bss = bss;
+		t->size = size;
+	}
+
+	if ((uint32_t)(t->count + 1) * 2 > t->mask + 1 &&
+	    iwinfo_bss_rehash(t, t->count + 1))
+		return -1;
+
+	bss = &t->bss[t->count];
+	memset(bss, 0, sizeof(*bss));
+
+	bss->e = *e;
+	bss->first_gen = t->generation;
+	bss->prev = bss->next = -1;
+
+	for (h = iwinfo_machash(e->mac, t->mask); t->slots[h];
+	     h = (h + 1) & t->mask);
+
+	t->slots[h] = ++t->count;
+
+	iwinfo_bss_append(t, t->count - 1);
+	iwinfo_bss_touch(t, t->count - 1);
+
+	return t->count - 1;
+}
+
+/* drop entries gone for longer than keep_gone, keeping the list order */
+static int iwinfo_bss_purge(struct iwinfo_bss_table *t)
+{
+	struct iwinfo_bss *bss;
+	int i, n = 0;
+
+	if (!(bss = malloc(t->size * sizeof(*bss))))
+		return -1;
+
+	for (i = t->head; i >= 0; i = t->bss[i].next)
+	{
+		if (t->bss[i].gone_gen &&
+		    t->bss[i].gone_gen + t->keep_gone < t->generation)
+			continue;
+
+		bss[n] = t->bss[i];
+		bss[n].prev = n - 1;
+		bss[n].next = n + 1;
+		n++;
+	}
+
+	if (n > 0)
+		bss[n - 1].next = -1;
+
+	free(t->bss);
+
+	t->bss = bss;
+	t->count = n;
+	t->head = n ? 0 : -1;
+	t->tail = n - 1;
+
+	return iwinfo_bss_rehash(t, n);
+}
+
+int iwinfo_bss_table_init(struct iwinfo_bss_table *t, uint32_t max_age)
+{
+	memset(t, 0, sizeof(*t));
+
+	t->head = t->tail = -1;
+	t->max_age = max_age;
+	t->keep_gone = IWINFO_BSS_KEEP_GONE;
+
+	return 0;
+}
+
+/*
+ * Merge a scanlist result into the table and return the new generation.
+ * Results may come from a cache, their age is taken into account when
+ * deciding whether a BSS is still around.
+ */
+int iwinfo_bss_table_merge(struct iwinfo_bss_table *t, const char *buf, int len)
+{
+	const struct iwinfo_scanlist_entry *e;
+	struct iwinfo_bss *b;
+	uint64_t now = iwinfo_msec(), seen;
+	int i, idx, purge = 0;
+
+	t->generation++;
+
+	for (i = 0; i + (int)sizeof(*e) <= len; i += sizeof(*e))
+	{
+		e = (const struct iwinfo_scanlist_entry *)&buf[i];
+		seen = (now > e->age) ? now - e->age : 0;
+
+		if ((idx = iwinfo_bss_find(t, e->mac)) < 0)
+		{
+			if ((idx = iwinfo_bss_add(t, e)) < 0)
+				return -1;
+		}
+		else
+		{
+			b = &t->bss[idx];
+
+			/* stale cache entry of something we already saw later */
+			if (seen < b->last_seen)
+				continue;
+
+			if (b->gone_gen)
+			{
+				b->gone_gen = 0;
+				b->first_gen = t->generation;
+				b->e = *e;
+				iwinfo_bss_touch(t, idx);
+			}
+			else if (iwinfo_bss_changed(b, e))
+			{
+				b->e = *e;
+				iwinfo_bss_touch(t, idx);
+			}
+			else
+			{
+				b->e = *e;
+			}
+		}
+
+		b = &t->bss[idx];
+		b->last_seen = seen;
+		iwinfo_bss_history_push(b, (int8_t)e->signal);
+	}
+
+	for (i = 0; i < t->count; i++)
+	{
+		b = &t->bss[i];
+
+		if (!b->gone_gen && t->max_age && b->last_seen + t->max_age < now)
+		{
+			b->gone_gen = t->generation;
+			iwinfo_bss_touch(t, i);
+		}
+		else if (b->gone_gen &&
+		         b->gone_gen + t->keep_gone < t->generation)
+		{
+			purge = 1;
+		}
+	}
+
+	if (purge && iwinfo_bss_purge(t))
+		return -1;
+
+	return t->generation;
+}
+
+const struct iwinfo_bss * iwinfo_bss_table_lookup(const struct iwinfo_bss_table *t,
+                                                  const uint8_t *mac)
+{
+	int i = iwinfo_bss_find(t, mac);
+
+	return (i >= 0 && !t->bss[i].gone_gen) ? &t->bss[i] : NULL;
+}
+
+/*
+ * Walk the BSSes with an event after generation since, newest first.
+ * Start with *iter = 0, it holds the next position + 1 afterwards and is
+ * negative once done; change is set to one of enum iwinfo_bss_change.
+ * Only the part of the change list newer than since is visited.
+ */
+const struct iwinfo_bss * iwinfo_bss_table_changes(const struct iwinfo_bss_table *t,
+                                                   uint32_t since, int *iter,
+                                                   int *change)
+{
+	const struct iwinfo_bss *b;
+	int i;
+
+	if (*iter < 0)
+		return NULL;
+
+	i = *iter ? *iter - 1 : t->tail;
+
+	while (i >= 0)
+	{
+		b = &t->bss[i];
+
+		if (b->gen <= since)
+			break;
+
+		i = b->prev;
+
+		/* came and went without the caller ever seeing it */
+		if (b->first_gen > since && b->gone_gen)
+			continue;
+
+		if (b->first_gen > since)
+			*change = IWINFO_BSS_NEW;
+		else if (b->gone_gen)
+			*change = IWINFO_BSS_GONE;
+		else
+			*change = IWINFO_BSS_CHANGED;
+
+		*iter = (i >= 0) ? i + 1 : -1;
+		return b;
+	}
+
+	*iter = -1;
+	return NULL;
+}
+
+/* signal samples in dBm, oldest first */
+int iwinfo_bss_signal_history(const struct iwinfo_bss *b, int8_t *buf)
+{
+	int i, start = (b->hist_pos + IWINFO_BSS_HISTORY - b->hist_len) %
+	               IWINFO_BSS_HISTORY;
+
+	for (i = 0; i < b->hist_len; i++)
+		buf[i] = b->history[(start + i) % IWINFO_BSS_HISTORY];
+
+	return b->hist_len;
+}
+
+void iwinfo_bss_table_free(struct iwinfo_bss_table *t)
+{
+	free(t->bss);
+	free(t->slots);
+
+	memset(t, 0, sizeof(*t));
+	t->head = t->tail = -1;
+}
@@ -0,0 +1,567 @@
+/*
+ * iwinfo - Wireless Information Library - Channel ranking
+ *
+ * The iwinfo library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * The iwinfo library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with the iwinfo library. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include "iwinfo/utils.h"
+
+
+static int iwinfo_rank_find(const struct iwinfo_chanrank *r, uint32_t mhz)
+{
+	int lo = 0, hi = r->count - 1, mid;
+
+	while (lo <= hi)
+	{
+		mid = (lo + hi) / 2;
+
+		if (r->chan[mid].mhz == mhz)
+			return mid;
+
+		if (r->chan[mid].mhz < mhz)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+
+	return -1;
+}
+
+static uint32_t iwinfo_rank_chan2freq(uint8_t band, uint8_t chan)
+{
+	if (!chan)
+		return 0;
+
+	switch (band)
+	{
+	case IWINFO_BAND_24:
+		return (chan == 14) ? 2484 : 2407 + chan * 5;
+
+	case IWINFO_BAND_5:
+		return 5000 + chan * 5;
+
+	case IWINFO_BAND_6:
+		return 5950 + chan * 5;
+
+	default:
+		return 0;
+	}
+}
+
+/* the lowest frequency of the channel blocks wider channels are made of */
+static uint32_t iwinfo_rank_block_base(const struct iwinfo_rank_channel *c)
+{
+	switch (c->band)
+	{
+	case IWINFO_BAND_5:
+		return (c->mhz >= 5745) ? 5745 : 5180;
+
+	case IWINFO_BAND_6:
+		return 5955;
+
+	default:
+		return 0;
+	}
+}
+
+static int iwinfo_rank_cand_add(struct iwinfo_chanrank *r, int primary,
+                                uint16_t width, uint32_t center,
+                                const uint8_t *member, int n)
+{
+	struct iwinfo_rank_candidate *c;
+	int size;
+
+	if (r->n_cand == r->size)
+	{
+		size = r->size ? r->size * 2 : 64;
+
+		if (!(c = realloc(r->cand, size * sizeof(*c))))
+			return -1;
+
+		r->cand = c;
+		r->size = size;
+	}
+
+	c = &r->cand[r->n_cand++];
+	memset(c, 0, sizeof(*c));
+
+	c->mhz = r->chan[primary].mhz;
+	c->band = r->chan[primary].band;
+	c->channel = r->chan[primary].channel;
+	c->width = width;
+	c->center = center;
+	c->n_members = n;
+	memcpy(c->member, member, n);
+
+	return 0;
+}
+
+static uint32_t iwinfo_rank_width_flag(uint16_t width)
+{
+	switch (width)
+	{
+	case 80:
+		return IWINFO_FREQ_NO_80MHZ;
+
+	case 160:
+		return IWINFO_FREQ_NO_160MHZ;
+
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Every channel is a candidate primary of a 20 MHz channel and of each
+ * aligned 40/80/160/320 MHz block containing it, as far as the block is
+ * complete, usable for initiating radiation and allowed by the flags.
+ * 2.4 GHz only gets HT40 above and below.
+ */
+static int iwinfo_rank_build(struct iwinfo_chanrank *r)
+{
+	const struct iwinfo_rank_channel *c;
+	uint8_t member[IWINFO_RANK_MAX_MEMBERS];
+	uint32_t base, lo;
+	uint16_t width;
+	int i, j, k, n, idx;
+
+	r->n_cand = 0;
+
+	for (i = 0; i < r->count; i++)
+	{
+		c = &r->chan[i];
+
+		if (c->flags & IWINFO_FREQ_NO_IR)
+			continue;
+
+		member[0] = i;
+
+		if (iwinfo_rank_cand_add(r, i, 20, c->mhz, member, 1))
+			return -1;
+
+		if (r->max_width < 40)
+			continue;
+
+		if (c->band == IWINFO_BAND_24)
+		{
+			for (k = -1; k <= 1; k += 2)
+			{
+				if ((k > 0 && (c->flags & IWINFO_FREQ_NO_HT40PLUS)) ||
+				    (k < 0 && (c->flags & IWINFO_FREQ_NO_HT40MINUS)))
+					continue;
+
+				if ((j = iwinfo_rank_find(r, c->mhz + k * 20)) < 0 ||
+				    (r->chan[j].flags & IWINFO_FREQ_NO_IR))
+					continue;
+
+				member[1] = j;
+
+				if (iwinfo_rank_cand_add(r, i, 40, c->mhz + k * 10,
+				                         member, 2))
+					return -1;
+			}
+
+			continue;
+		}
+
+		if (!(base = iwinfo_rank_block_base(c)) || c->mhz < base)
+			continue;
+
+		for (width = 40; width <= r->max_width && width <= 320; width *= 2)
+		{
+			if (width == 320 && c->band != IWINFO_BAND_6)
+				break;
+
+			n = width / 20;
+			lo = c->mhz - ((c->mhz - base) / 20 % n) * 20;
+
+			/* HT40 needs the secondary above resp. below the primary */
+			if (width == 40 &&
+			    (c->flags & ((c->mhz == lo) ? IWINFO_FREQ_NO_HT40PLUS
+			                                : IWINFO_FREQ_NO_HT40MINUS)))
+				break;
+
+			for (j = 0, k = 1; j < n; j++)
+			{
+				if (lo + j * 20 == c->mhz)
+					continue;
+
+				if ((idx = iwinfo_rank_find(r, lo + j * 20)) < 0 ||
+				    (r->chan[idx].flags &
+				     (IWINFO_FREQ_NO_IR | iwinfo_rank_width_flag(width))))
+					break;
+
+				member[k++] = idx;
+			}
+
+			if (j < n || (c->flags & iwinfo_rank_width_flag(width)))
+				break;
+
+			if (iwinfo_rank_cand_add(r, i, width, lo + width / 2 - 10,
+			                         member, n))
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+int iwinfo_chanrank_init(struct iwinfo_chanrank *r, uint16_t max_width)
+{
+	memset(r, 0, sizeof(*r));
+
+	r->max_width = max_width ? max_width : 20;
+
+	return 0;
+}
+
+static int iwinfo_rank_cmp_freq(const void *a, const void *b)
+{
+	const struct iwinfo_freqlist_entry *x = a, *y = b;
+
+	return (int)x->mhz - (int)y->mhz;
+}
+
+/*
+ * Take the frequency table of the radio. Survey and scan state is kept
+ * for channels that remain; candidates are only rebuilt if the table or
+ * its flags changed.
+ */
+int iwinfo_chanrank_freqlist(struct iwinfo_chanrank *r,
+                             const char *buf, int len)
+{
+	struct iwinfo_freqlist_entry f[IWINFO_RANK_MAX_CHANNELS];
+	struct iwinfo_rank_channel chan[IWINFO_RANK_MAX_CHANNELS];
+	int i, j, n = len / sizeof(f[0]);
+
+	if (n > IWINFO_RANK_MAX_CHANNELS)
+		n = IWINFO_RANK_MAX_CHANNELS;
+
+	memcpy(f, buf, n * sizeof(f[0]));
+	qsort(f, n, sizeof(f[0]), iwinfo_rank_cmp_freq);
+
+	if (n == r->count)
+	{
+		for (i = 0; i < n; i++)
+			if (r->chan[i].mhz != f[i].mhz || r->chan[i].flags != f[i].flags)
+				break;
+
+		if (i == n)
+			return 0;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		if ((j = iwinfo_rank_find(r, f[i].mhz)) >= 0)
+			chan[i] = r->chan[j];
+		else
+			memset(&chan[i], 0, sizeof(chan[i]));
+
+		chan[i].mhz = f[i].mhz;
+		chan[i].band = f[i].band;
+		chan[i].channel = f[i].channel;
+		chan[i].flags = f[i].flags;
+		chan[i].dirty = 1;
+	}
+
+	memcpy(r->chan, chan, n * sizeof(chan[0]));
+	r->count = n;
+
+	return iwinfo_rank_build(r);
+}
+
+/*
+ * Fold in the latest sample of every channel the sampler has seen since
+ * the previous call. Our own transmissions are not contention and are
+ * taken off the busy time. Returns the number of channels updated.
+ */
+int iwinfo_chanrank_survey(struct iwinfo_chanrank *r,
+                           const struct iwinfo_survey_sampler *s)
+{
+	const struct iwinfo_survey_sample *smp;
+	struct iwinfo_rank_channel *c;
+	uint16_t busy;
+	int i, j, n = 0;
+
+	for (i = 0; i < s->count; i++)
+	{
+		if (!(smp = iwinfo_survey_latest(&s->chan[i])) ||
+		    (j = iwinfo_rank_find(r, s->chan[i].mhz)) < 0)
+			continue;
+
+		c = &r->chan[j];
+
+		if (smp->stamp <= c->survey_stamp)
+			continue;
+
+		busy = (smp->busy > smp->tx) ? smp->busy - smp->tx : 0;
+
+		c->busy = c->have_survey ? (c->busy * 3 + busy) / 4 : busy;
+		c->noise = smp->noise;
+		c->have_survey = 1;
+		c->survey_stamp = smp->stamp;
+		c->dirty = 1;
+		n++;
+	}
+
+	return n;
+}
+
+/* the frequency range a BSS occupies, from its widest operation element */
+static void iwinfo_rank_span(const struct iwinfo_scanlist_entry *e,
+                             uint32_t *lo, uint32_t *hi)
+{
+	const struct iwinfo_scanlist_vht_chan_entry *vht = &e->vht_chan_info;
+	const struct iwinfo_scanlist_he_chan_entry *he = &e->he_chan_info;
+	const struct iwinfo_scanlist_eht_chan_entry *eht = &e->eht_chan_info;
+	uint32_t center = e->mhz;
+	uint16_t width = 20;
+
+	if (eht->present && eht->chan_width <= 4 && eht->center_chan_1)
+	{
+		width = 20 << eht->chan_width;
+		center = iwinfo_rank_chan2freq(e->band, (width >= 160)
+			? eht->center_chan_2 : eht->center_chan_1);
+	}
+	else if (he->present && he->primary_chan && he->center_chan_1)
+	{
+		width = 20 << he->chan_width;
+		center = iwinfo_rank_chan2freq(e->band,
+			(width == 160 && he->center_chan_2)
+				? he->center_chan_2 : he->center_chan_1);
+	}
+	else if (vht->chan_width && vht->center_chan_1)
+	{
+		if (vht->chan_width == 2)
+		{
+			width = 160;
+			center = iwinfo_rank_chan2freq(e->band, vht->center_chan_1);
+		}
+		else if (vht->center_chan_2 &&
+		         (vht->center_chan_2 - vht->center_chan_1 == 8 ||
+		          vht->center_chan_1 - vht->center_chan_2 == 8))
+		{
+			width = 160;
+			center = iwinfo_rank_chan2freq(e->band, vht->center_chan_2);
+		}
+		else
+		{
+			/* the secondary 80 MHz of 80+80 is not accounted for */
+			width = 80;
+			center = iwinfo_rank_chan2freq(e->band, vht->center_chan_1);
+		}
+	}
+	else if (e->ht_chan_info.chan_width &&
+	         (e->ht_chan_info.secondary_chan_off == 1 ||
+	          e->ht_chan_info.secondary_chan_off == 3))
+	{
+		width = 40;
+		center = (e->ht_chan_info.secondary_chan_off == 1)
+			? e->mhz + 10 : e->mhz - 10;
+	}
+
+	/* garbage in the elements, stay with the primary */
+	if (!center || e->mhz + 10 <= center - width / 2 ||
+	    e->mhz - 10 >= center + width / 2)
+	{
+		center = e->mhz;
+		width = 20;
+	}
+
+	*lo = center - width / 2;
+	*hi = center + width / 2;
+}
+
+/* a BSS at -50 dBm or stronger weighs 250, nothing below -100 dBm */
+static uint32_t iwinfo_rank_bss_weight(int8_t signal)
+{
+	int w = (signal + 100) * 5;
+
+	return (w < 0) ? 0 : (w > 250) ? 250 : w;
+}
+
+static void iwinfo_rank_set(struct iwinfo_rank_channel *c, uint16_t *field,
+                            uint32_t val)
+{
+	if (val > 1000)
+		val = 1000;
+
+	if (*field != val)
+	{
+		*field = val;
+		c->dirty = 1;
+	}
+}
+
+/*
+ * Replace the scan derived state with a new scan result. A BSS counts on
+ * every channel of ours its operating width overlaps, on 2.4 GHz that
+ * includes the partially overlapping neighbours. Returns the number of
+ * channels whose state changed.
+ */
+int iwinfo_chanrank_scan(struct iwinfo_chanrank *r, const char *buf, int len)
+{
+	const struct iwinfo_scanlist_entry *e;
+	uint32_t prim[IWINFO_RANK_MAX_CHANNELS] = { 0 };
+	uint32_t over[IWINFO_RANK_MAX_CHANNELS] = { 0 };
+	uint32_t load[IWINFO_RANK_MAX_CHANNELS] = { 0 };
+	uint32_t lo, hi, w, util;
+	int i, j, dirty, n = 0;
+
+	for (i = 0; i + (int)sizeof(*e) <= len; i += sizeof(*e))
+	{
+		e = (const struct iwinfo_scanlist_entry *)&buf[i];
+
+		iwinfo_rank_span(e, &lo, &hi);
+
+		w = iwinfo_rank_bss_weight((int8_t)e->signal);
+		util = e->load.present ? e->load.chan_util * 1000 / 255 : 0;
+
+		for (j = 0; j < r->count && r->chan[j].mhz - 10 < hi; j++)
+		{
+			if (r->chan[j].mhz + 10 <= lo)
+				continue;
+
+			if (r->chan[j].mhz == e->mhz)
+				prim[j] += w;
+			else
+				over[j] += w;
+
+			if (util > load[j])
+				load[j] = util;
+		}
+	}
+
+	for (j = 0; j < r->count; j++)
+	{
+		dirty = r->chan[j].dirty;
+		r->chan[j].dirty = 0;
+
+		iwinfo_rank_set(&r->chan[j], &r->chan[j].bss_primary, prim[j]);
+		iwinfo_rank_set(&r->chan[j], &r->chan[j].bss_overlap, over[j]);
+		iwinfo_rank_set(&r->chan[j], &r->chan[j].bss_load, load[j]);
+
+		n += r->chan[j].dirty;
+		r->chan[j].dirty |= dirty;
+	}
+
+	return n;
+}
+
+static void iwinfo_rank_score(const struct iwinfo_chanrank *r,
+                              struct iwinfo_rank_candidate *cand)
+{
+	struct iwinfo_rank_score *s = &cand->score;
+	const struct iwinfo_rank_channel *c;
+	uint32_t util, noise, bss = 0;
+	uint64_t total;
+	int k;
+
+	memset(s, 0, sizeof(*s));
+
+	for (k = 0; k < cand->n_members; k++)
+	{
+		c = &r->chan[cand->member[k]];
+
+		/* the busiest subchannel limits the whole channel */
+		if (c->have_survey && c->busy >= s->util)
+		{
+			s->util = c->busy;
+			s->util_source = IWINFO_RANK_UTIL_SURVEY;
+		}
+		else if (!c->have_survey && c->bss_load > s->util)
+		{
+			s->util = c->bss_load;
+			s->util_source = IWINFO_RANK_UTIL_BSS_LOAD;
+		}
+
+		if (c->noise && c->noise > -95)
+		{
+			noise = (c->noise + 95) * 20;
+
+			if (noise > s->noise)
+				s->noise = (noise > 1000) ? 1000 : noise;
+		}
+
+		/* BSSes sharing our primary defer to us like we defer to
+		 * them, on our secondaries their primaries do not */
+		if (k == 0)
+			bss += c->bss_primary + c->bss_overlap;
+		else
+			bss += c->bss_primary * 2 + c->bss_overlap;
+	}
+
+	s->bss = (bss > 1000) ? 1000 : bss;
+
+	util = 1000 - s->util;
+	total = (uint64_t)cand->width * 10 * util * (1000 - s->bss) *
+	        (1000 - s->noise) / 1000000000ULL;
+
+	s->total = (uint32_t)total;
+}
+
+static int iwinfo_rank_cmp(const void *a, const void *b)
+{
+	const struct iwinfo_rank_candidate *x = a, *y = b;
+
+	if (x->score.total != y->score.total)
+		return (x->score.total < y->score.total) ? 1 : -1;
+
+	/* equally good, the narrower channel leaves room for others */
+	if (x->width != y->width)
+		return (int)x->width - (int)y->width;
+
+	return (int)x->mhz - (int)y->mhz;
+}
+
+/*
+ * Rescore the candidates covering a channel with new input and return
+ * the number of candidates, r->cand is sorted best first.
+ */
+int iwinfo_chanrank_rank(struct iwinfo_chanrank *r)
+{
+	struct iwinfo_rank_candidate *c;
+	int i, k;
+
+	for (i = 0, c = r->cand; i < r->n_cand; i++, c++)
+	{
+		for (k = 0; k < c->n_members; k++)
+		{
+			if (r->chan[c->member[k]].dirty)
+			{
+				iwinfo_rank_score(r, c);
+				r->unsorted = 1;
+				break;
+			}
+		}
+	}
+
+	for (i = 0; i < r->count; i++)
+		r->chan[i].dirty = 0;
+
+	if (r->unsorted)
+	{
+		qsort(r->cand, r->n_cand, sizeof(*r->cand), iwinfo_rank_cmp);
+		r->unsorted = 0;
+	}
+
+	return r->n_cand;
+}
+
+void iwinfo_chanrank_free(struct iwinfo_chanrank *r)
+{
+	free(r->cand);
+
+	r->cand = NULL;
+	r->n_cand = r->size = 0;
+}
@@ -18,11 +18,20 @@
 
 #include <stdio.h>
 #include <glob.h>
+#include <poll.h>
 #include <stdbool.h>
 
 #include "iwinfo.h"
 
 
+struct scan_args {
+	struct iwinfo_scan_opts opts;
+	bool targeted;
+	bool filtered;
+	bool cached;
+	uint32_t max_age;
+};
+
 static char * format_bssid(unsigned char *mac)
 {
 	static char buf[18];
@@ -172,6 +181,25 @@ static char * format_rate(int rate)
 	return buf;
 }
 
+static char * format_chains(uint8_t mask, const int8_t *sig, const char *unit)
+{
+	static char buf[64];
+	char *p = buf;
+	int i;
+
+	for (i = 0; i < IWINFO_MAX_CHAINS && (mask >> i); i++)
+	{
+		if (mask & (1 << i))
+			p += snprintf(p, sizeof(buf) - (p - buf), "%s%d", i ? ", " : "", sig[i]);
+		else
+			p += snprintf(p, sizeof(buf) - (p - buf), "%s-", i ? ", " : "");
+	}
+
+	snprintf(p, sizeof(buf) - (p - buf), " %s", unit);
+
+	return buf;
+}
+
 static char * format_enc_ciphers(int ciphers)
 {
 	static char str[128] = { 0 };
@@ -364,6 +392,21 @@ static const char* format_chan_width(bool vht, uint8_t width)
 }
 
 
+static const char* format_he_chan_width(bool eht, uint8_t width)
+{
+	static char buf[10];
+
+	if (!eht && width < ARRAY_SIZE(he_chan_width))
+		snprintf(buf, sizeof(buf), "%u MHz", he_chan_width[width]);
+	else if (eht && width < ARRAY_SIZE(eht_chan_width))
+		snprintf(buf, sizeof(buf), "%u MHz", eht_chan_width[width]);
+	else
+		return "unknown";
+
+	return buf;
+}
+
+
 static const char * print_type(const struct iwinfo_ops *iw, const char *ifname)
 {
 	const char *type = iwinfo_type(ifname);
@@ -664,23 +707,48 @@ static void print_info(const struct iwinfo_ops *iw, const char *ifname)
 }
 
 
-static void print_scanlist(const struct iwinfo_ops *iw, const char *ifname)
+static int do_scan(const struct iwinfo_ops *iw, const char *ifname,
+                   const struct scan_args *sa, char *buf, int *len)
 {
-	int i, x, len;
-	char buf[IWINFO_BUFSIZE];
-	struct iwinfo_scanlist_entry *e;
+	int rv;
 
-	if (iw->scanlist(ifname, buf, &len))
+	if (sa && sa->cached)
 	{
-		printf("Scanning not possible\n\n");
-		return;
+		if (!iw->scan_results)
+		{
+			printf("Cached scan results not supported\n\n");
+			return 1;
+		}
+
+		rv = iw->scan_results(ifname, sa->max_age, buf, len);
 	}
-	else if (len <= 0)
+	else if (sa && (sa->targeted || (sa->filtered && iw->scan)))
 	{
-		printf("No scan results\n\n");
-		return;
+		if (!iw->scan)
+		{
+			printf("Scan options not supported\n\n");
+			return 1;
+		}
+
+		return iw->scan(ifname, &sa->opts, buf, len);
+	}
+	else
+	{
+		rv = iw->scanlist(ifname, buf, len);
 	}
 
+	/* results the backend did not filter while parsing */
+	if (!rv && sa && sa->filtered)
+		*len = iwinfo_scanlist_filter(buf, *len, &sa->opts.filter);
+
+	return rv;
+}
+
+static void print_scan_entries(const char *buf, int len)
+{
+	int i, x;
+	struct iwinfo_scanlist_entry *e;
+
 	for (i = 0, x = 1; i < len; i += sizeof(struct iwinfo_scanlist_entry), x++)
 	{
 		e = (struct iwinfo_scanlist_entry *) &buf[i];
@@ -701,6 +769,18 @@ static void print_scanlist(const struct iwinfo_ops *iw, const char *ifname)
 			format_quality_max(e->quality_max));
 		printf("          Encryption: %s\n",
 			format_encryption(&e->crypto));
+
+		if (e->age)
+			printf("          Last seen: %u ms ago\n", e->age);
+
+		if (e->mbssid_index)
+			printf("          Multiple BSSID Index: %d\n", e->mbssid_index);
+
+		if (e->load.present)
+			printf("          Load: %d%% / %u STA\n",
+				(e->load.chan_util * 100 + 127) / 255,
+				e->load.sta_count);
+
 		printf("          HT Operation:\n");
 		printf("                    Primary Channel: %d\n",
 			e->ht_chan_info.primary_chan);
@@ -719,10 +799,128 @@ static void print_scanlist(const struct iwinfo_ops *iw, const char *ifname)
 				format_chan_width(true, e->vht_chan_info.chan_width));
 		}
 
+		if (e->he_chan_info.present) {
+			printf("          HE Operation:\n");
+
+			if (e->he_chan_info.bss_color)
+				printf("                    BSS Color: %d\n",
+					e->he_chan_info.bss_color);
+			else
+				printf("                    BSS Color: disabled\n");
+
+			if (e->he_chan_info.primary_chan) {
+				printf("                    6 GHz Primary Channel: %d\n",
+					e->he_chan_info.primary_chan);
+				printf("                    Center Frequency 1: %d\n",
+					e->he_chan_info.center_chan_1);
+				printf("                    Center Frequency 2: %d\n",
+					e->he_chan_info.center_chan_2);
+				printf("                    Channel Width: %s\n",
+					format_he_chan_width(false, e->he_chan_info.chan_width));
+			}
+		}
+
+		if (e->eht_chan_info.center_chan_1) {
+			printf("          EHT Operation:\n");
+			printf("                    Center Frequency 1: %d\n",
+				e->eht_chan_info.center_chan_1);
+			printf("                    Center Frequency 2: %d\n",
+				e->eht_chan_info.center_chan_2);
+			printf("                    Channel Width: %s\n",
+				format_he_chan_width(true, e->eht_chan_info.chan_width));
+
+			if (e->eht_chan_info.disabled_subchans)
+				printf("                    Disabled Subchannels: 0x%04x\n",
+					e->eht_chan_info.disabled_subchans);
+		}
+
 		printf("\n");
 	}
 }
 
+static void print_scanlist(const struct iwinfo_ops *iw, const char *ifname,
+                           const struct scan_args *sa)
+{
+	int len, rv, method;
+	uint64_t start = iwinfo_msec();
+	char buf[IWINFO_BUFSIZE];
+
+	if ((rv = do_scan(iw, ifname, sa, buf, &len)) > 0)
+		return;
+
+	start = iwinfo_msec() - start;
+
+	if (rv)
+	{
+		printf("Scanning not possible\n\n");
+		return;
+	}
+	else if (len <= 0)
+	{
+		printf("No scan results\n\n");
+		return;
+	}
+
+	print_scan_entries(buf, len);
+
+	if (!(sa && sa->cached) && iw->scan_method &&
+	    !iw->scan_method(ifname, &method))
+		printf("Scanned via %s in %u ms\n\n",
+		       IWINFO_SCAN_METHOD_NAMES[method], (uint32_t)start);
+}
+
+static void print_sched_scan(const struct iwinfo_ops *iw, const char *ifname,
+                             const struct iwinfo_sched_scan_opts *opts,
+                             bool follow)
+{
+	int len, rv;
+	char buf[IWINFO_BUFSIZE];
+	struct iwinfo_scan *scan = NULL;
+	struct pollfd pfd;
+
+	if (!iw->sched_scan_start)
+	{
+		printf("Scheduled scans not supported\n");
+		return;
+	}
+
+	if (iw->sched_scan_start(ifname, opts, follow ? &scan : NULL))
+	{
+		printf("Scheduled scan not possible\n");
+		return;
+	}
+
+	printf("Scheduled scan started\n");
+
+	if (!scan)
+		return;
+
+	pfd.fd = iw->scan_fd(scan);
+	pfd.events = POLLIN;
+
+	while (poll(&pfd, 1, -1) >= 0)
+	{
+		rv = iw->scan_collect(scan, buf, &len);
+
+		if (rv == -EAGAIN)
+			continue;
+
+		if (rv)
+		{
+			printf("Scheduled scan stopped\n");
+			break;
+		}
+
+		printf("--- %d results ---\n\n",
+			(int)(len / sizeof(struct iwinfo_scanlist_entry)));
+
+		print_scan_entries(buf, len);
+		fflush(stdout);
+	}
+
+	iw->scan_abort(scan);
+}
+
 
 static void print_txpwrlist(const struct iwinfo_ops *iw, const char *ifname)
 {
@@ -788,6 +986,7 @@ static void print_assoclist(const struct iwinfo_ops *iw, const char *ifname)
 	int i, len;
 	char buf[IWINFO_BUFSIZE];
 	struct iwinfo_assoclist_entry *e;
+	struct iwinfo_chain_stats cs;
 
 	if (iw->assoclist(ifname, buf, &len))
 	{
@@ -821,9 +1020,341 @@ static void print_assoclist(const struct iwinfo_ops *iw, const char *ifname)
 			e->tx_packets
 		);
 
+		if (e->chains)
+		{
+			printf("	chains: %s",
+				format_chains(e->chains, e->chain_signal, "dBm"));
+
+			if (e->chains_avg)
+				printf(" (avg %s)",
+					format_chains(e->chains_avg, e->chain_signal_avg, "dBm"));
+
+			printf("\n");
+		}
+
+		if (e->ack_signal)
+		{
+			printf("	ACK signal: %s", format_signal(e->ack_signal));
+
+			if (e->ack_signal_avg)
+				printf(" (avg %s)", format_signal(e->ack_signal_avg));
+
+			printf("\n");
+		}
+
+		if (e->beacon_signal_avg)
+			printf("	beacon signal: %s, %llu received, %u lost\n",
+				format_signal(e->beacon_signal_avg),
+				(unsigned long long)e->beacon_rx, e->beacon_loss);
+
+		if (e->ifname[0] && strcmp(e->ifname, ifname))
+			printf("	interface: %s\n", e->ifname);
+
 		printf("	expected throughput: %s\n\n",
 			format_rate(e->thr));
 	}
+
+	if (!iwinfo_chain_imbalance(buf, len, &cs))
+		printf("Chain imbalance: %d dB over %d stations (offsets %s)\n",
+			cs.imbalance, cs.stations,
+			format_chains(cs.chains, cs.offset, "dB"));
+}
+
+static int sort_airtime(const void *a, const void *b)
+{
+	const struct iwinfo_assoclist_delta *da = a, *db = b;
+	uint64_t ta = da->rx_duration + da->tx_duration;
+	uint64_t tb = db->rx_duration + db->tx_duration;
+
+	return (ta < tb) - (ta > tb);
+}
+
+/* two assoclist samples interval ms apart, turned into a delta */
+static int sample_assoclist(const struct iwinfo_ops *iw, const char *ifname,
+                            int interval, char *buf, int *len, uint64_t *ms)
+{
+	int plen, clen, rv = -1;
+	uint64_t t0;
+	char *prev, *cur;
+
+	if (!(prev = malloc(2 * IWINFO_BUFSIZE)))
+		return -1;
+
+	cur = prev + IWINFO_BUFSIZE;
+
+	if (iw->assoclist(ifname, prev, &plen))
+	{
+		printf("No information available\n");
+		goto out;
+	}
+
+	t0 = iwinfo_msec();
+	usleep((useconds_t)interval * 1000);
+
+	if (iw->assoclist(ifname, cur, &clen))
+	{
+		printf("No information available\n");
+		goto out;
+	}
+
+	*ms = iwinfo_msec() - t0;
+
+	if (iwinfo_assoclist_delta(prev, plen, cur, clen, *ms, buf, len) ||
+	    *len <= 0)
+	{
+		printf("No station connected\n");
+		goto out;
+	}
+
+	rv = 0;
+
+out:
+	free(prev);
+	return rv;
+}
+
+static void print_airtime(const struct iwinfo_ops *iw, const char *ifname,
+                          int interval)
+{
+	int i, len;
+	uint64_t ms;
+	char buf[IWINFO_BUFSIZE];
+	struct iwinfo_assoclist_delta *d;
+
+	if (sample_assoclist(iw, ifname, interval, buf, &len, &ms))
+		return;
+
+	qsort(buf, len / sizeof(*d), sizeof(*d), sort_airtime);
+
+	printf("%-17s  %7s  %7s  %10s  %10s  %6s\n",
+		"Station", "Airtime", "Share", "RX time", "TX time", "Weight");
+
+	for (i = 0; i < len; i += sizeof(*d))
+	{
+		d = (struct iwinfo_assoclist_delta *) &buf[i];
+
+		printf("%-17s  %5.1f %%  %5.1f %%  %7llu ms  %7llu ms  %6d\n",
+			format_bssid(d->mac),
+			d->airtime / 10.0, d->airtime_share / 10.0,
+			(unsigned long long)(d->rx_duration / 1000),
+			(unsigned long long)(d->tx_duration / 1000),
+			d->airtime_weight);
+	}
+
+	printf("\nInterval: %llu ms\n", (unsigned long long)ms);
+}
+
+static void print_per(const struct iwinfo_ops *iw, const char *ifname,
+                      int interval)
+{
+	int i, len;
+	uint64_t ms;
+	char buf[IWINFO_BUFSIZE];
+	struct iwinfo_assoclist_delta *d;
+	struct iwinfo_link_summary st;
+
+	if (sample_assoclist(iw, ifname, interval, buf, &len, &ms))
+		return;
+
+	printf("%-17s  %7s  %7s  %17s  %14s\n",
+		"Station", "RX PER", "TX PER", "FCS err / MPDUs", "Beacon loss");
+
+	for (i = 0; i < len; i += sizeof(*d))
+	{
+		d = (struct iwinfo_assoclist_delta *) &buf[i];
+
+		printf("%-17s  %5.1f %%  %5.1f %%  %7u / %7u  %5u (%5u/h)\n",
+			format_bssid(d->mac),
+			d->rx_per / 10.0, d->tx_per / 10.0,
+			d->fcs_errors, d->rx_mpdus,
+			d->beacon_loss, d->beacon_loss_rate);
+	}
+
+	if (!iwinfo_link_summary(buf, len, &st))
+	{
+		printf("\n%d stations: RX PER %.1f %%, TX PER %.1f %%, "
+		       "%u beacon loss events\n",
+			st.stations, st.rx_per / 10.0, st.tx_per / 10.0,
+			st.beacon_loss);
+
+		if (st.worst_rx_per)
+			printf("Worst RX: %s (%.1f %%)\n",
+				format_bssid(st.worst_rx_mac), st.worst_rx_per / 10.0);
+
+		if (st.worst_tx_per)
+			printf("Worst TX: %s (%.1f %%)\n",
+				format_bssid(st.worst_tx_mac), st.worst_tx_per / 10.0);
+	}
+
+	printf("\nInterval: %llu ms\n", (unsigned long long)ms);
+}
+
+static int get_survey(const struct iwinfo_ops *iw, const char *ifname,
+                      int mode, char *buf, int *len)
+{
+	if (mode != IWINFO_SURVEY_ALL)
+		return iw->survey_mode ? iw->survey_mode(ifname, mode, buf, len) : -1;
+
+	if (!iw->survey || iw->survey(ifname, buf, len))
+		return -1;
+
+	return 0;
+}
+
+static void print_survey(const struct iwinfo_ops *iw, const char *ifname,
+                         int interval, int mode)
+{
+	int i, len;
+	uint64_t t0, t1;
+	char buf[IWINFO_BUFSIZE];
+	struct iwinfo_survey_sampler s;
+	const struct iwinfo_survey_sample *smp;
+
+	if (mode != IWINFO_SURVEY_ALL && !iw->survey_mode)
+	{
+		printf("Survey mode not supported\n");
+		return;
+	}
+
+	if (get_survey(iw, ifname, mode, buf, &len) || len <= 0)
+	{
+		printf("No survey information available\n");
+		return;
+	}
+
+	iwinfo_survey_sampler_init(&s);
+	iwinfo_survey_sampler_update(&s, buf, len);
+
+	t0 = iwinfo_msec();
+	usleep((useconds_t)interval * 1000);
+
+	if (get_survey(iw, ifname, mode, buf, &len))
+		len = 0;
+
+	t1 = iwinfo_msec();
+
+	if (iwinfo_survey_sampler_update(&s, buf, len) <= 0)
+	{
+		printf("No survey information available\n");
+		iwinfo_survey_sampler_free(&s);
+		return;
+	}
+
+	printf("%-9s  %8s  %7s  %7s  %7s  %7s  %7s  %s\n",
+		"Frequency", "Active", "Busy", "Ext", "RX", "TX", "Other", "Noise");
+
+	for (i = 0; i < s.count; i++)
+	{
+		if (!(smp = iwinfo_survey_latest(&s.chan[i])) || smp->stamp != s.stamp)
+			continue;
+
+		printf("%-9s  %5u ms  %5.1f %%  %5.1f %%  %5.1f %%  %5.1f %%  "
+		       "%5.1f %%  %s\n",
+			s.chan[i].mhz ? format_frequency(s.chan[i].mhz) : "radio",
+			smp->active,
+			smp->busy / 10.0, smp->busy_ext / 10.0,
+			smp->rx / 10.0, smp->tx / 10.0, smp->other / 10.0,
+			format_noise(smp->noise));
+	}
+
+	printf("\nInterval: %llu ms\n", (unsigned long long)(t1 - t0));
+
+	iwinfo_survey_sampler_free(&s);
+}
+
+static void print_txq(const struct iwinfo_ops *iw, const char *ifname,
+                      int interval)
+{
+	int i, ac, plen, clen, len, idle;
+	bool have_txq = false;
+	uint64_t t0, t1;
+	char *prev, *cur, *buf;
+	struct iwinfo_txq_stats q0, q1, qd;
+	struct iwinfo_assoclist_delta *d;
+	struct iwinfo_ac_stats *a;
+
+	/* three buffers are too much for the stack */
+	if (!(prev = malloc(3 * IWINFO_BUFSIZE)))
+		return;
+
+	cur = prev + IWINFO_BUFSIZE;
+	buf = cur + IWINFO_BUFSIZE;
+
+	if (iw->txq_stats && !iw->txq_stats(ifname, &q0))
+		have_txq = true;
+
+	if (iw->assoclist(ifname, prev, &plen))
+		plen = 0;
+
+	t0 = iwinfo_msec();
+	usleep((useconds_t)interval * 1000);
+
+	if (have_txq && iw->txq_stats(ifname, &q1))
+		have_txq = false;
+
+	if (iw->assoclist(ifname, cur, &clen))
+		clen = 0;
+
+	t1 = iwinfo_msec();
+
+	if (!have_txq && (plen <= 0 || clen <= 0))
+	{
+		printf("No information available\n");
+		free(prev);
+		return;
+	}
+
+	if (have_txq)
+	{
+		iwinfo_txq_delta(&q0, &q1, &qd);
+
+		printf("%s: backlog %u bytes / %u pkts, %u pkts dequeued\n",
+			ifname, qd.backlog_bytes, qd.backlog_packets, qd.tx_packets);
+
+		printf("	drops: %u, ECN marks: %u, overlimit: %u, "
+		       "overmemory: %u, collisions: %u, new flows: %u\n\n",
+			qd.drops, qd.ecn_marks, qd.overlimit,
+			qd.overmemory, qd.collisions, qd.flows);
+	}
+
+	if (!iwinfo_assoclist_delta(prev, plen, cur, clen, t1 - t0, buf, &len))
+	{
+		for (i = 0; i < len; i += sizeof(*d))
+		{
+			d = (struct iwinfo_assoclist_delta *) &buf[i];
+
+			printf("%s\n", format_bssid(d->mac));
+
+			for (ac = 0, idle = 1; ac < IWINFO_AC_COUNT; ac++)
+			{
+				a = &d->ac[ac];
+
+				if (!a->rx_msdu && !a->tx_msdu &&
+				    !a->txq.backlog_packets && !a->txq.drops)
+					continue;
+
+				printf("	%s: backlog %6u B / %4u pkts  "
+				       "RX %6llu  TX %6llu  retries %5llu  failed %4llu  "
+				       "drops %4u  ECN %4u\n",
+					IWINFO_AC_NAMES[ac],
+					a->txq.backlog_bytes, a->txq.backlog_packets,
+					(unsigned long long)a->rx_msdu,
+					(unsigned long long)a->tx_msdu,
+					(unsigned long long)a->tx_msdu_retries,
+					(unsigned long long)a->tx_msdu_failed,
+					a->txq.drops, a->txq.ecn_marks);
+
+				idle = 0;
+			}
+
+			if (idle)
+				printf("	idle\n");
+		}
+	}
+
+	printf("\nInterval: %llu ms\n", (unsigned long long)(t1 - t0));
+
+	free(prev);
 }
 
 
@@ -918,10 +1449,230 @@ static void lookup_path(const struct iwinfo_ops *iw, const char *phy)
 	printf("%s\n", path);
 }
 
+static const char * next_option(int argc, char **argv, int *i)
+{
+	if (*i + 1 >= argc || strncmp(argv[*i + 1], "--", 2))
+		return NULL;
+
+	return argv[++(*i)] + 2;
+}
+
+static const char * next_value(int argc, char **argv, int *i)
+{
+	return (*i + 1 < argc) ? argv[++(*i)] : NULL;
+}
+
+static int parse_list(const char *val, const char * const *names,
+                      const uint8_t *bits, uint8_t *mask)
+{
+	const char *p, *end;
+	int n;
+
+	for (p = val; *p; p = *end ? end + 1 : end)
+	{
+		end = p + strcspn(p, ",");
+
+		for (n = 0; names[n]; n++)
+			if (!strncmp(p, names[n], end - p) && !names[n][end - p])
+				break;
+
+		if (!names[n])
+			return -1;
+
+		*mask |= bits[n];
+	}
+
+	return 0;
+}
+
+/* returns 1 if opt is not a filter option */
+static int parse_scan_filter(const char *opt, int argc, char **argv, int *i,
+                             struct iwinfo_scan_filter *f)
+{
+	const char *val;
+	char *p;
+
+	static const char * const bands[] = { "2.4", "5", "6", "60", NULL };
+	static const uint8_t band_bits[] = {
+		IWINFO_BAND_24, IWINFO_BAND_5, IWINFO_BAND_6, IWINFO_BAND_60
+	};
+
+	static const char * const cryptos[] = {
+		"open", "wep", "wpa", "wpa2", "wpa3", "encrypted", NULL
+	};
+	static const uint8_t crypto_bits[] = {
+		IWINFO_SCAN_CRYPTO_OPEN, IWINFO_SCAN_CRYPTO_WEP,
+		IWINFO_SCAN_CRYPTO_WPA, IWINFO_SCAN_CRYPTO_WPA2,
+		IWINFO_SCAN_CRYPTO_WPA3,
+		IWINFO_SCAN_CRYPTO_WEP | IWINFO_SCAN_CRYPTO_WPA |
+		IWINFO_SCAN_CRYPTO_WPA2 | IWINFO_SCAN_CRYPTO_WPA3
+	};
+
+	if (strcmp(opt, "match") && strcmp(opt, "band") &&
+	    strcmp(opt, "channel") && strcmp(opt, "min-signal") &&
+	    strcmp(opt, "crypto") && strcmp(opt, "top"))
+		return 1;
+
+	if (!(val = next_value(argc, argv, i)))
+		return -1;
+
+	if (!strcmp(opt, "match"))
+	{
+		if (strlen(val) > IWINFO_ESSID_MAX_SIZE)
+			return -1;
+
+		strcpy(f->ssid, val);
+		return 0;
+	}
+	else if (!strcmp(opt, "band"))
+		return parse_list(val, bands, band_bits, &f->bands);
+	else if (!strcmp(opt, "crypto"))
+		return parse_list(val, cryptos, crypto_bits, &f->crypto);
+	else if (!strcmp(opt, "channel"))
+		f->channel = strtoul(val, &p, 10);
+	else if (!strcmp(opt, "min-signal"))
+		f->min_signal = strtol(val, &p, 10);
+	else
+		f->top = strtoul(val, &p, 10);
+
+	return (p == val || *p) ? -1 : 0;
+}
+
+static int parse_scan_option(const char *opt, int argc, char **argv, int *i,
+                             struct scan_args *sa)
+{
+	const char *val;
+	char *p, *next;
+	struct iwinfo_scan_opts *so = &sa->opts;
+
+	int rv;
+
+	if (!strcmp(opt, "cached"))
+	{
+		sa->cached = true;
+		return sa->targeted ? -1 : 0;
+	}
+
+	if ((rv = parse_scan_filter(opt, argc, argv, i, &so->filter)) <= 0)
+	{
+		sa->filtered = true;
+		return rv;
+	}
+
+	if (strcmp(opt, "max-age"))
+		sa->targeted = true;
+
+	if (!strcmp(opt, "passive"))
+		so->flags |= IWINFO_SCAN_F_PASSIVE;
+	else if (!strcmp(opt, "low-priority"))
+		so->flags |= IWINFO_SCAN_F_LOW_PRIORITY;
+	else if (!strcmp(opt, "low-span"))
+		so->flags |= IWINFO_SCAN_F_LOW_SPAN;
+	else if (!strcmp(opt, "flush"))
+		so->flags |= IWINFO_SCAN_F_FLUSH;
+	else if (!strcmp(opt, "rnr"))
+		so->flags |= IWINFO_SCAN_F_RNR_6GHZ;
+	else if (!(val = next_value(argc, argv, i)))
+		return -1;
+	else if (!strcmp(opt, "max-age"))
+	{
+		sa->cached = true;
+		sa->max_age = atoi(val);
+	}
+	else if (!strcmp(opt, "dwell"))
+		so->dwell = atoi(val);
+	else if (!strcmp(opt, "ssid"))
+	{
+		if (so->n_ssids >= IWINFO_SCAN_MAX_SSIDS ||
+		    strlen(val) > IWINFO_ESSID_MAX_SIZE)
+			return -1;
+
+		strcpy(so->ssids[so->n_ssids++], val);
+	}
+	else if (!strcmp(opt, "freq"))
+	{
+		for (p = (char *)val; *p; p = next)
+		{
+			if (so->n_freqs >= IWINFO_SCAN_MAX_FREQS)
+				return -1;
+
+			so->freqs[so->n_freqs++] = strtoul(p, &next, 10);
+
+			if (next == p || (*next && *next++ != ','))
+				return -1;
+		}
+	}
+	else
+		return -1;
+
+	/* cached results are read as they are, nothing is triggered */
+	return (sa->cached && sa->targeted) ? -1 : 0;
+}
+
+static int parse_sched_scan_option(const char *opt, int argc, char **argv,
+                                   int *i, struct iwinfo_sched_scan_opts *so)
+{
+	const char *val;
+	char *p;
+	struct iwinfo_sched_scan_plan *pl;
+	struct scan_args sa = { .opts = so->scan };
+
+	if (!strcmp(opt, "interval") || !strcmp(opt, "plan"))
+	{
+		if (!(val = next_value(argc, argv, i)) ||
+		    so->n_plans >= IWINFO_SCHED_SCAN_MAX_PLANS)
+			return -1;
+
+		pl = &so->plans[so->n_plans++];
+		pl->interval = strtoul(val, &p, 10);
+
+		if (*p == ':')
+			pl->iterations = strtoul(p + 1, &p, 10);
+
+		return (pl->interval && !*p) ? 0 : -1;
+	}
+	else if (!strcmp(opt, "delay"))
+	{
+		if (!(val = next_value(argc, argv, i)))
+			return -1;
+
+		so->delay = atoi(val);
+	}
+	else if (!strcmp(opt, "match"))
+	{
+		if (!(val = next_value(argc, argv, i)) ||
+		    so->n_matches >= IWINFO_SCHED_SCAN_MAX_MATCHES ||
+		    strlen(val) > IWINFO_ESSID_MAX_SIZE)
+			return -1;
+
+		strcpy(so->matches[so->n_matches++].ssid, val);
+	}
+	else if (!strcmp(opt, "min-signal"))
+	{
+		if (!(val = next_value(argc, argv, i)))
+			return -1;
+
+		so->min_rssi = atoi(val);
+	}
+	else if (!parse_scan_option(opt, argc, argv, i, &sa) && !sa.cached)
+	{
+		so->scan = sa.opts;
+	}
+	else
+		return -1;
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
-	int i, rv = 0;
+	int i, rv = 0, interval, mode;
+	bool badopt;
 	char *p;
+	const char *opt, *val, *cmd;
+	struct scan_args sa = { };
+	struct iwinfo_sched_scan_opts ss;
+	bool follow;
 	const struct iwinfo_ops *iw;
 	glob_t globbuf;
 
@@ -930,12 +1681,27 @@ int main(int argc, char **argv)
 		fprintf(stderr,
 			"Usage:\n"
 			"	iwinfo <device> info\n"
-			"	iwinfo <device> scan\n"
+			"	iwinfo <device> scan [--freq <mhz>[,<mhz>...]] [--ssid <ssid>]\n"
+			"	                     [--passive] [--dwell <tu>] [--flush]\n"
+			"	                     [--low-priority] [--low-span] [--rnr]\n"
+			"	iwinfo <device> scan --cached [--max-age <ms>]\n"
+			"	       scan filters: [--match <ssid>] [--band 2.4|5|6|60[,...]]\n"
+			"	                     [--channel <n>] [--min-signal <dBm>] [--top <n>]\n"
+			"	                     [--crypto open|wep|wpa|wpa2|wpa3|encrypted[,...]]\n"
+			"	iwinfo <device> schedscan start [--interval <s>] [--plan <s>:<n>]\n"
+			"	                     [--delay <s>] [--match <ssid>] [--min-signal <dBm>]\n"
+			"	                     [--freq <mhz>[,<mhz>...]] [--passive] [--follow]\n"
+			"	iwinfo <device> schedscan stop\n"
+			"	iwinfo <device> schedscan results [--max-age <ms>]\n"
 			"	iwinfo <device> txpowerlist\n"
 			"	iwinfo <device> freqlist\n"
 			"	iwinfo <device> assoclist\n"
 			"	iwinfo <device> countrylist\n"
 			"	iwinfo <device> htmodelist\n"
+			"	iwinfo <device> airtime [--interval <ms>]\n"
+			"	iwinfo <device> txq [--interval <ms>]\n"
+			"	iwinfo <device> per [--interval <ms>]\n"
+			"	iwinfo <device> survey [--interval <ms>] [--in-use|--radio]\n"
 			"	iwinfo <backend> phyname <section>\n"
 		);
 
@@ -966,31 +1732,23 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
-	if (argc > 3)
+	/* device commands may carry options, so only treat known backend
+	 * names as backend lookups */
+	if (argc > 3 && (iw = iwinfo_backend_by_name(argv[1])) != NULL)
 	{
-		iw = iwinfo_backend_by_name(argv[1]);
-
-		if (!iw)
-		{
-			fprintf(stderr, "No such wireless backend: %s\n", argv[1]);
-			rv = 1;
+		if (!strcmp(argv[2], "path")) {
+			lookup_path(iw, argv[3]);
+			return 0;
 		}
-		else
+		switch (argv[2][0])
 		{
-			if (!strcmp(argv[2], "path")) {
-				lookup_path(iw, argv[3]);
-				return 0;
-			}
-			switch (argv[2][0])
-			{
-			case 'p':
-				lookup_phy(iw, argv[3]);
-				break;
+		case 'p':
+			lookup_phy(iw, argv[3]);
+			break;
 
-			default:
-				fprintf(stderr, "Unknown command: %s\n", argv[2]);
-				rv = 1;
-			}
+		default:
+			fprintf(stderr, "Unknown command: %s\n", argv[2]);
+			rv = 1;
 		}
 	}
 	else
@@ -1006,6 +1764,135 @@ int main(int argc, char **argv)
 		{
 			for (i = 2; i < argc; i++)
 			{
+				if (!strcmp(argv[i], "scan") &&
+				    i + 1 < argc && !strncmp(argv[i + 1], "--", 2))
+				{
+					memset(&sa, 0, sizeof(sa));
+					badopt = false;
+
+					while ((opt = next_option(argc, argv, &i)) != NULL)
+					{
+						if (parse_scan_option(opt, argc, argv, &i, &sa))
+						{
+							fprintf(stderr, "Invalid option: --%s\n", opt);
+							badopt = true;
+						}
+					}
+
+					if (badopt)
+						rv = 1;
+					else
+						print_scanlist(iw, argv[1], &sa);
+
+					continue;
+				}
+
+				if (!strcmp(argv[i], "schedscan"))
+				{
+					cmd = (i + 1 < argc) ? argv[++i] : "";
+					memset(&ss, 0, sizeof(ss));
+					memset(&sa, 0, sizeof(sa));
+					badopt = false;
+					follow = false;
+
+					while ((opt = next_option(argc, argv, &i)) != NULL)
+					{
+						if (!strcmp(cmd, "start") && !strcmp(opt, "follow"))
+						{
+							follow = true;
+						}
+						else if (!strcmp(cmd, "start") &&
+						         !parse_sched_scan_option(opt, argc, argv, &i, &ss))
+						{
+							continue;
+						}
+						else if (!strcmp(cmd, "results") &&
+						         !parse_scan_option(opt, argc, argv, &i, &sa) &&
+						         sa.cached)
+						{
+							continue;
+						}
+						else
+						{
+							fprintf(stderr, "Invalid option: --%s\n", opt);
+							badopt = true;
+						}
+					}
+
+					if (badopt)
+					{
+						rv = 1;
+					}
+					else if (!strcmp(cmd, "start"))
+					{
+						print_sched_scan(iw, argv[1], &ss, follow);
+					}
+					else if (!strcmp(cmd, "stop"))
+					{
+						if (!iw->sched_scan_stop || iw->sched_scan_stop(argv[1]))
+							printf("No scheduled scan running\n");
+					}
+					else if (!strcmp(cmd, "results"))
+					{
+						/* scheduled scans feed the regular BSS cache */
+						sa.cached = true;
+						print_scanlist(iw, argv[1], &sa);
+					}
+					else
+					{
+						fprintf(stderr, "Unknown schedscan command: %s\n", cmd);
+						rv = 1;
+					}
+
+					continue;
+				}
+
+				if (!strcmp(argv[i], "airtime") || !strcmp(argv[i], "txq") ||
+				    !strcmp(argv[i], "per") || !strcmp(argv[i], "survey"))
+				{
+					cmd = argv[i];
+					interval = 1000;
+					mode = IWINFO_SURVEY_ALL;
+					badopt = false;
+
+					while ((opt = next_option(argc, argv, &i)) != NULL)
+					{
+						/* up to an hour, the sleep takes microseconds */
+						if (!strcmp(opt, "interval") &&
+						    (val = next_value(argc, argv, &i)) != NULL &&
+						    atoi(val) > 0 && atoi(val) <= 3600 * 1000)
+						{
+							interval = atoi(val);
+						}
+						else if (!strcmp(cmd, "survey") && !strcmp(opt, "in-use"))
+						{
+							mode = IWINFO_SURVEY_IN_USE;
+						}
+						else if (!strcmp(cmd, "survey") && !strcmp(opt, "radio"))
+						{
+							mode = IWINFO_SURVEY_RADIO;
+						}
+						else
+						{
+							fprintf(stderr, "Invalid option: --%s\n", opt);
+							badopt = true;
+						}
+					}
+
+					if (badopt)
+						rv = 1;
+					else if (!strcmp(cmd, "txq"))
+						print_txq(iw, argv[1], interval);
+					else if (!strcmp(cmd, "per"))
+						print_per(iw, argv[1], interval);
+					else if (!strcmp(cmd, "survey"))
+						print_survey(iw, argv[1], interval, mode);
+					else
+						print_airtime(iw, argv[1], interval);
+
+					continue;
+				}
+
 				switch(argv[i][0])
 				{
 				case 'i':
@@ -1013,7 +1900,7 @@ int main(int argc, char **argv)
 					break;
 
 				case 's':
-					print_scanlist(iw, argv[1]);
+					print_scanlist(iw, argv[1], NULL);
 					break;
 
 				case 't':
@@ -33,6 +33,22 @@ const char * const IWINFO_80211_NAMES[IWINFO_80211_COUNT] = {
 	"be",
 };
 
+const char * const IWINFO_AC_NAMES[IWINFO_AC_COUNT] = {
+	"BE",
+	"BK",
+	"VI",
+	"VO",
+};
+
+const char * const IWINFO_SCAN_METHOD_NAMES[IWINFO_SCAN_METHOD_COUNT] = {
+	"unknown",
+	"wpa_supplicant",
+	"direct",
+	"AP interface",
+	"temporary interface",
+	"temporary interface, AP down",
+};
+
 const char * const IWINFO_BAND_NAMES[IWINFO_BAND_COUNT] = {
 	"2.4 GHz",
 	"5 GHz",
@@ -133,6 +149,21 @@ const uint16_t vht_chan_width[4] = {
 	8080, /* 80+80 MHz */
 };
 
+const uint16_t he_chan_width[4] = {
+	20,
+	40,
+	80,
+	160, /* 160 or 80+80 MHz */
+};
+
+const uint16_t eht_chan_width[5] = {
+	20,
+	40,
+	80,
+	160,
+	320,
+};
+
 /*
  * ISO3166 country labels
  */
@@ -388,6 +419,11 @@ const struct iwinfo_iso3166_label IWINFO_ISO3166_NAMES[] = {
 	{ 0,               "" }
 };
 
+struct iwinfo_tunables iwinfo_tunables = {
+	.noise_cache_ms = 1000,
+	.madwifi_vap_idle_ms = 0,
+};
+
 static const struct iwinfo_ops *backends[] = {
 #ifdef USE_NL80211
 	&nl80211_ops,
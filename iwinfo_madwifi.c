@@ -336,6 +336,84 @@ static void madwifi_ifdel(const char *ifname)
 	iwinfo_ioctl(SIOC80211IFDESTROY, &ifr);
 }
 
+/*
+ * Scans on a wifiX device without a usable VAP need a temporary one. If
+ * iwinfo_tunables.madwifi_vap_idle_ms is set, it is taken down after each
+ * scan but kept for that long after its last use so that repeated scans do
+ * not create and destroy it every time. There is no timer, an expired VAP
+ * is removed on the next call or in madwifi_close().
+ */
+static struct {
+	char ifname[IFNAMSIZ];
+	char wifidev[IFNAMSIZ];
+	uint64_t last_used;
+} madwifi_tmpvap;
+
+static void madwifi_tmpvap_destroy(void)
+{
+	if( madwifi_tmpvap.ifname[0] )
+	{
+		iwinfo_ifdown(madwifi_tmpvap.ifname);
+		madwifi_ifdel(madwifi_tmpvap.ifname);
+	}
+
+	memset(&madwifi_tmpvap, 0, sizeof(madwifi_tmpvap));
+}
+
+/* the kept VAP of wifidev, if still usable */
+static const char * madwifi_tmpvap_lookup(const char *wifidev)
+{
+	if( !madwifi_tmpvap.ifname[0] )
+		return NULL;
+
+	if( strcmp(madwifi_tmpvap.wifidev, wifidev) ||
+	    (iwinfo_msec() - madwifi_tmpvap.last_used >
+	     iwinfo_tunables.madwifi_vap_idle_ms) )
+	{
+		madwifi_tmpvap_destroy();
+		return NULL;
+	}
+
+	return madwifi_tmpvap.ifname;
+}
+
+static const char * madwifi_tmpvap_get(const char *wifidev)
+{
+	const char *res;
+	char *nif;
+
+	if( (res = madwifi_tmpvap_lookup(wifidev)) != NULL && iwinfo_ifup(res) )
+		return res;
+
+	/* vanished or went down underneath us */
+	madwifi_tmpvap_destroy();
+
+	if( (nif = madwifi_ifadd(wifidev)) == NULL )
+		return NULL;
+
+	if( !iwinfo_ifup(nif) )
+	{
+		iwinfo_ifdown(nif);
+		madwifi_ifdel(nif);
+		return NULL;
+	}
+
+	strncpy(madwifi_tmpvap.ifname, nif, IFNAMSIZ - 1);
+	strncpy(madwifi_tmpvap.wifidev, wifidev, IFNAMSIZ - 1);
+
+	return madwifi_tmpvap.ifname;
+}
+
+static void madwifi_tmpvap_put(void)
+{
+	madwifi_tmpvap.last_used = iwinfo_msec();
+
+	if( !iwinfo_tunables.madwifi_vap_idle_ms )
+		madwifi_tmpvap_destroy();
+	else
+		iwinfo_ifdown(madwifi_tmpvap.ifname);
+}
+
 
 static int madwifi_probe(const char *ifname)
 {
@@ -344,7 +422,8 @@ static int madwifi_probe(const char *ifname)
 
 static void madwifi_close(void)
 {
-	/* Nop */
+	madwifi_tmpvap_destroy();
+	wext_scan_close();
 }
 
 static int madwifi_get_mode(const char *ifname, int *buf)
@@ -777,6 +856,7 @@ static int madwifi_get_assoclist(const char *ifname, char *buf, int *len)
 			entry.signal = (si->isi_rssi - 95);
 			entry.noise  = noise;
 			memcpy(entry.mac, &si->isi_macaddr, 6);
+			strncpy(entry.ifname, ifname, sizeof(entry.ifname) - 1);
 
 			entry.inactive = si->isi_inact * 1000;
 
@@ -812,12 +892,18 @@ static int madwifi_get_assoclist(const char *ifname, char *buf, int *len)
 static int madwifi_get_txpwrlist(const char *ifname, char *buf, int *len)
 {
 	int rc = -1;
+	const char *vap;
 	char *res;
 
 	/* A wifiX device? */
 	if( madwifi_iswifi(ifname) )
 	{
-		if( (res = madwifi_ifadd(ifname)) != NULL )
+		/* the name of the scan VAP would clash with a new one */
+		if( (vap = madwifi_tmpvap_lookup(ifname)) != NULL )
+		{
+			rc = wext_ops.txpwrlist(vap, buf, len);
+		}
+		else if( (res = madwifi_ifadd(ifname)) != NULL )
 		{
 			rc = wext_ops.txpwrlist(res, buf, len);
 			madwifi_ifdel(res);
@@ -836,7 +922,7 @@ static int madwifi_get_txpwrlist(const char *ifname, char *buf, int *len)
 static int madwifi_get_scanlist(const char *ifname, char *buf, int *len)
 {
 	int ret;
-	char *res;
+	const char *res;
 	DIR *proc;
 	struct dirent *e;
 
@@ -853,7 +939,7 @@ static int madwifi_get_scanlist(const char *ifname, char *buf, int *len)
 				{
 					if( iwinfo_ifup(e->d_name) )
 					{
-						ret = wext_ops.scanlist(e->d_name, buf, len);
+						ret = wext_scan(e->d_name, buf, len, 0);
 						break;
 					}
 				}
@@ -862,24 +948,14 @@ static int madwifi_get_scanlist(const char *ifname, char *buf, int *len)
 			closedir(proc);
 		}
 
-		/* Still nothing found, try to create a vap */
+		/* Still nothing found, use a temporary vap; the results
+		 * are only read once the driver signals the end of the scan */
 		if( ret == -1 )
 		{
-			if( (res = madwifi_ifadd(ifname)) != NULL )
+			if( (res = madwifi_tmpvap_get(ifname)) != NULL )
 			{
-				if( iwinfo_ifup(res) )
-				{
-					wext_ops.scanlist(res, buf, len);
-					sleep(1);
-
-					wext_ops.scanlist(res, buf, len);
-					sleep(1);
-
-					ret = wext_ops.scanlist(res, buf, len);
-				}
-
-				iwinfo_ifdown(res);
-				madwifi_ifdel(res);
+				ret = wext_scan(res, buf, len, 0);
+				madwifi_tmpvap_put();
 			}
 		}
 	}
@@ -887,7 +963,7 @@ static int madwifi_get_scanlist(const char *ifname, char *buf, int *len)
 	/* Got athX device? */
 	else if( !!madwifi_isvap(ifname, NULL) )
 	{
-		ret = wext_ops.scanlist(ifname, buf, len);
+		ret = wext_scan(ifname, buf, len, 0);
 	}
 
 	return ret;
@@ -897,6 +973,7 @@ static int madwifi_get_freqlist(const char *ifname, char *buf, int *len)
 {
 	int i, bl;
 	int rc = -1;
+	const char *vap;
 	char *res;
 	struct ieee80211req_chaninfo chans;
 	struct iwinfo_freqlist_entry entry;
@@ -904,7 +981,12 @@ static int madwifi_get_freqlist(const char *ifname, char *buf, int *len)
 	/* A wifiX device? */
 	if( madwifi_iswifi(ifname) )
 	{
-		if( (res = madwifi_ifadd(ifname)) != NULL )
+		if( (vap = madwifi_tmpvap_lookup(ifname)) != NULL )
+		{
+			rc = get80211priv(vap, IEEE80211_IOCTL_GETCHANINFO,
+							  &chans, sizeof(chans));
+		}
+		else if( (res = madwifi_ifadd(ifname)) != NULL )
 		{
 			rc = get80211priv(res, IEEE80211_IOCTL_GETCHANINFO,
 							  &chans, sizeof(chans));
@@ -1045,7 +1127,16 @@ static int madwifi_get_htmodelist(const char *ifname, int *buf)
 static int madwifi_get_mbssid_support(const char *ifname, int *buf)
 {
 	/* Test whether we can create another interface */
-	char *nif = madwifi_ifadd(ifname);
+	char *nif;
+
+	/* the kept scan VAP already is one */
+	if( madwifi_tmpvap_lookup(ifname) )
+	{
+		*buf = 1;
+		return 0;
+	}
+
+	nif = madwifi_ifadd(ifname);
 
 	if( nif )
 	{
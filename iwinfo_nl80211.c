@@ -41,11 +41,18 @@
 #define BIT(x) (1ULL<<(x))
 
 static struct nl80211_state *nls = NULL;
+static struct nl80211_scan_method nl80211_last_scan;
 
 static void nl80211_close(void)
 {
+	int i;
+
 	if (nls)
 	{
+		for (i = 0; i < NL80211_POOL_SIZE; i++)
+			if (nls->nl_pool[i])
+				nl_socket_free(nls->nl_pool[i]);
+
 		if (nls->nlctrl)
 			genl_family_put(nls->nlctrl);
 
@@ -502,6 +509,172 @@ static int nl80211_request(const char *ifname, int cmd, int flags,
 	return nl80211_send(cv, cb_func, cb_arg);
 }
 
+static int nl80211_pool_init(int count)
+{
+	int i, fd;
+	struct nl_sock *sock;
+
+	if (count > NL80211_POOL_SIZE)
+		count = NL80211_POOL_SIZE;
+
+	for (i = 0; i < count; i++)
+	{
+		if (nls->nl_pool[i])
+			continue;
+
+		sock = nl_socket_alloc();
+		if (!sock)
+			break;
+
+		if (genl_connect(sock) || nl_socket_set_nonblocking(sock))
+		{
+			nl_socket_free(sock);
+			break;
+		}
+
+		fd = nl_socket_get_fd(sock);
+		fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+
+		nls->nl_pool[i] = sock;
+	}
+
+	return i;
+}
+
+/*
+ * Issue the same request for a number of interfaces at once. The kernel
+ * refuses a second dump on a socket while one is still running, so each
+ * in-flight request gets its own socket from the pool and replies are
+ * drained as they become readable. Falls back to serial requests on the
+ * main socket if the pool cannot be set up.
+ */
+static int nl80211_request_multi(const char **ifnames, void **args, int count,
+                                 int cmd, int flags,
+                                 int (*cb_func)(struct nl_msg *, void *))
+{
+	struct nl80211_pool_slot slots[NL80211_POOL_SIZE] = { };
+	struct nl80211_msg_conveyor *cv;
+	struct pollfd pfd[NL80211_POOL_SIZE];
+	int i, n, err, next = 0, active = 0, nslots = 0;
+
+	if (nl80211_init() < 0)
+		return -ENOLINK;
+
+	if (count > 1)
+		nslots = nl80211_pool_init(count);
+
+	if (nslots < 2)
+	{
+		for (i = 0; i < count; i++)
+			nl80211_request(ifnames[i], cmd, flags, cb_func, args[i]);
+
+		return 0;
+	}
+
+	while (next < count || active > 0)
+	{
+		for (i = 0; i < nslots && next < count; i++)
+		{
+			if (slots[i].busy || !nls->nl_pool[i])
+				continue;
+
+			cv = nl80211_msg(ifnames[next], cmd, flags);
+			if (!cv)
+			{
+				next++;
+				continue;
+			}
+
+			slots[i].cv  = *cv;
+			slots[i].err = 1;
+
+			nl_cb_set(cv->cb, NL_CB_VALID,  NL_CB_CUSTOM, cb_func, args[next]);
+			nl_cb_err(cv->cb,               NL_CB_CUSTOM, nl80211_msg_error,  &slots[i].err);
+			nl_cb_set(cv->cb, NL_CB_FINISH, NL_CB_CUSTOM, nl80211_msg_finish, &slots[i].err);
+			nl_cb_set(cv->cb, NL_CB_ACK,    NL_CB_CUSTOM, nl80211_msg_ack,    &slots[i].err);
+
+			next++;
+
+			if (nl_send_auto_complete(nls->nl_pool[i], slots[i].cv.msg) < 0)
+			{
+				nl80211_free(&slots[i].cv);
+				continue;
+			}
+
+			slots[i].busy = 1;
+			active++;
+		}
+
+		/* no socket left to send on, finish on the main socket */
+		if (!active)
+		{
+			for (; next < count; next++)
+				nl80211_request(ifnames[next], cmd, flags, cb_func, args[next]);
+
+			break;
+		}
+
+		for (i = 0, n = 0; i < nslots; i++)
+		{
+			if (!slots[i].busy)
+				continue;
+
+			pfd[n].fd = nl_socket_get_fd(nls->nl_pool[i]);
+			pfd[n].events = POLLIN;
+			pfd[n].revents = 0;
+			n++;
+		}
+
+		if (poll(pfd, n, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			break;
+		}
+
+		for (i = 0, n = 0; i < nslots; i++)
+		{
+			if (!slots[i].busy)
+				continue;
+
+			if (!pfd[n++].revents)
+				continue;
+
+			err = nl_recvmsgs(nls->nl_pool[i], slots[i].cv.cb);
+
+			if (slots[i].err > 0 && (err >= 0 || err == -NLE_AGAIN))
+				continue;
+
+			nl80211_free(&slots[i].cv);
+			slots[i].busy = 0;
+			active--;
+
+			/* given up before the end of the dump, the rest of it would
+			 * end up in the replies to the next request on this socket */
+			if (slots[i].err > 0)
+			{
+				nl_socket_free(nls->nl_pool[i]);
+				nls->nl_pool[i] = NULL;
+				nl80211_pool_init(nslots);
+			}
+		}
+	}
+
+	/* only reached early on poll() failure, drop what is still pending */
+	for (i = 0; i < nslots; i++)
+	{
+		if (!slots[i].busy)
+			continue;
+
+		nl80211_free(&slots[i].cv);
+		nl_socket_free(nls->nl_pool[i]);
+		nls->nl_pool[i] = NULL;
+	}
+
+	return 0;
+}
+
 static struct nlattr ** nl80211_parse(struct nl_msg *msg)
 {
 	struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
@@ -568,7 +741,7 @@ static int nl80211_subscribe_cb(struct nl_msg *msg, void *arg)
 	return NL_SKIP;
 }
 
-static int nl80211_subscribe(const char *family, const char *group)
+static int nl80211_mcast_id(const char *family, const char *group)
 {
 	struct nl80211_group_conveyor cv = { .name = group, .id = -ENOENT };
 	struct nl80211_msg_conveyor *req;
@@ -580,10 +753,7 @@ static int nl80211_subscribe(const char *family, const char *group)
 		NLA_PUT_STRING(req->msg, CTRL_ATTR_FAMILY_NAME, family);
 		err = nl80211_send(req, nl80211_subscribe_cb, &cv);
 
-		if (err)
-			return err;
-
-		return nl_socket_add_membership(nls->nl_sock, cv.id);
+		return err ? err : cv.id;
 
 nla_put_failure:
 		nl80211_free(req);
@@ -592,6 +762,16 @@ nla_put_failure:
 	return -ENOMEM;
 }
 
+static int nl80211_subscribe(const char *family, const char *group)
+{
+	int id = nl80211_mcast_id(family, group);
+
+	if (id < 0)
+		return id;
+
+	return nl_socket_add_membership(nls->nl_sock, id);
+}
+
 
 static int nl80211_wait_cb(struct nl_msg *msg, void *arg)
 {
@@ -609,12 +789,13 @@ static int nl80211_wait_seq_check(struct nl_msg *msg, void *arg)
 	return NL_OK;
 }
 
-static int __nl80211_wait(const char *family, const char *group, ...)
+static int __nl80211_wait(const char *family, const char *group,
+                          uint64_t deadline, ...)
 {
 	struct nl80211_event_conveyor cv = { };
 	struct nl_cb *cb;
 	int err = 0;
-	int cmd;
+	int cmd, ready;
 	va_list ap;
 
 	if (nl80211_subscribe(family, group))
@@ -629,7 +810,7 @@ static int __nl80211_wait(const char *family, const char *group, ...)
 	nl_cb_set(cb, NL_CB_SEQ_CHECK, NL_CB_CUSTOM, nl80211_wait_seq_check, NULL);
 	nl_cb_set(cb, NL_CB_VALID,     NL_CB_CUSTOM, nl80211_wait_cb,        &cv );
 
-	va_start(ap, group);
+	va_start(ap, deadline);
 
 	for (cmd = va_arg(ap, int); cmd != 0; cmd = va_arg(ap, int))
 		cv.wait[cmd / 32] |= (1 << (cmd % 32));
@@ -637,15 +818,30 @@ static int __nl80211_wait(const char *family, const char *group, ...)
 	va_end(ap);
 
 	while (!cv.recv && !err)
+	{
+		/* a zero deadline waits for as long as it takes */
+		if (deadline)
+		{
+			ready = iwinfo_wait_fd(nl_socket_get_fd(nls->nl_sock), deadline);
+
+			if (ready <= 0)
+			{
+				err = ready ? -errno : -ETIMEDOUT;
+				break;
+			}
+		}
+
 		nl_recvmsgs(nls->nl_sock, cb);
+	}
 
 	nl_cb_put(cb);
 
-	return err;
+	return err ? err : cv.recv;
 }
 
-#define nl80211_wait(family, group, ...) \
-	__nl80211_wait(family, group, __VA_ARGS__, 0)
+/* returns the command received or a negative error */
+#define nl80211_wait(family, group, deadline, ...) \
+	__nl80211_wait(family, group, deadline, __VA_ARGS__, 0)
 
 /* This is linux's ieee80211_freq_khz_to_channel() which is:
  * SPDX-License-Identifier: GPL-2.0
@@ -954,20 +1150,12 @@ static int __nl80211_hostapd_query(const char *ifname, ...)
 	__nl80211_hostapd_query(ifname, ##__VA_ARGS__, NULL)
 
 
-static inline int nl80211_wpactl_recv(int sock, char *buf, int blen)
+static inline int nl80211_wpactl_recv(int sock, char *buf, int blen,
+                                      uint64_t deadline)
 {
-	fd_set rfds;
-	struct timeval tv = { 0, 256000 };
-
-	FD_ZERO(&rfds);
-	FD_SET(sock, &rfds);
-
 	memset(buf, 0, blen);
 
-	if (select(sock + 1, &rfds, NULL, NULL, &tv) < 0)
-		return -1;
-
-	if (!FD_ISSET(sock, &rfds))
+	if (iwinfo_wait_fd(sock, deadline) <= 0)
 		return -1;
 
 	return recv(sock, buf, blen - 1, 0);
@@ -1066,7 +1254,8 @@ static int __nl80211_wpactl_query(const char *ifname, ...)
 
 	while (true)
 	{
-		if (nl80211_wpactl_recv(sock, buf, sizeof(buf)) <= 0)
+		if (nl80211_wpactl_recv(sock, buf, sizeof(buf),
+		                        iwinfo_msec() + NL80211_WPACTL_TIMEOUT) <= 0)
 			break;
 
 		if (buf[0] == '<')
@@ -1577,28 +1766,56 @@ static int nl80211_fill_signal_cb(struct nl_msg *msg, void *arg)
 	return NL_SKIP;
 }
 
-static void nl80211_fill_signal(const char *ifname, struct nl80211_rssi_rate *r)
+/* Find the interface itself and its WDS station interfaces ifname.staN */
+static int nl80211_get_subifs(const char *ifname, const char **names, int max)
 {
-	DIR *d;
+	static char subifs[NL80211_MAX_SUBIFS][IFNAMSIZ];
+	size_t len = strlen(ifname);
 	struct dirent *de;
+	int count = 0;
+	DIR *d;
 
-	memset(r, 0, sizeof(*r));
+	if (max > NL80211_MAX_SUBIFS)
+		max = NL80211_MAX_SUBIFS;
 
-	if ((d = opendir("/sys/class/net")) != NULL)
+	if ((d = opendir("/sys/class/net")) == NULL)
+		return -1;
+
+	while (count < max && (de = readdir(d)) != NULL)
 	{
-		while ((de = readdir(d)) != NULL)
+		if (strlen(de->d_name) >= IFNAMSIZ)
+			continue;
+
+		if (!strncmp(de->d_name, ifname, len) &&
+		    (!de->d_name[len] || !strncmp(&de->d_name[len], ".sta", 4)))
 		{
-			if (!strncmp(de->d_name, ifname, strlen(ifname)) &&
-			    (!de->d_name[strlen(ifname)] ||
-			     !strncmp(&de->d_name[strlen(ifname)], ".sta", 4)))
-			{
-				nl80211_request(de->d_name, NL80211_CMD_GET_STATION,
-				                NLM_F_DUMP, nl80211_fill_signal_cb, r);
-			}
+			snprintf(subifs[count], IFNAMSIZ, "%s", de->d_name);
+			names[count] = subifs[count];
+			count++;
 		}
-
-		closedir(d);
 	}
+
+	closedir(d);
+
+	return count;
+}
+
+static void nl80211_fill_signal(const char *ifname, struct nl80211_rssi_rate *r)
+{
+	const char *names[NL80211_MAX_SUBIFS];
+	void *args[NL80211_MAX_SUBIFS];
+	int i, count;
+
+	memset(r, 0, sizeof(*r));
+
+	count = nl80211_get_subifs(ifname, names, NL80211_MAX_SUBIFS);
+
+	for (i = 0; i < count; i++)
+		args[i] = r;
+
+	if (count > 0)
+		nl80211_request_multi(names, args, count, NL80211_CMD_GET_STATION,
+		                      NLM_F_DUMP, nl80211_fill_signal_cb);
 }
 
 static int nl80211_get_bitrate(const char *ifname, int *buf)
@@ -1631,10 +1848,23 @@ static int nl80211_get_signal(const char *ifname, int *buf)
 	return -1;
 }
 
+/*
+ * Survey dumps carry nothing but the interface index and the survey info,
+ * find the latter instead of parsing the whole nl80211 attribute table for
+ * every channel.
+ */
+static struct nlattr * nl80211_survey_info(struct nl_msg *msg)
+{
+	struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
+
+	return nla_find(genlmsg_attrdata(gnlh, 0), genlmsg_attrlen(gnlh, 0),
+	                NL80211_ATTR_SURVEY_INFO);
+}
+
 static int nl80211_get_noise_cb(struct nl_msg *msg, void *arg)
 {
 	int8_t *noise = arg;
-	struct nlattr **tb = nl80211_parse(msg);
+	struct nlattr *info = nl80211_survey_info(msg);
 	struct nlattr *si[NL80211_SURVEY_INFO_MAX + 1];
 
 	static const struct nla_policy sp[NL80211_SURVEY_INFO_MAX + 1] = {
@@ -1642,11 +1872,7 @@ static int nl80211_get_noise_cb(struct nl_msg *msg, void *arg)
 		[NL80211_SURVEY_INFO_NOISE]     = { .type = NLA_U8  },
 	};
 
-	if (!tb[NL80211_ATTR_SURVEY_INFO])
-		return NL_SKIP;
-
-	if (nla_parse_nested(si, NL80211_SURVEY_INFO_MAX,
-	                     tb[NL80211_ATTR_SURVEY_INFO], sp))
+	if (!info || nla_parse_nested(si, NL80211_SURVEY_INFO_MAX, info, sp))
 		return NL_SKIP;
 
 	if (!si[NL80211_SURVEY_INFO_NOISE])
@@ -1659,14 +1885,49 @@ static int nl80211_get_noise_cb(struct nl_msg *msg, void *arg)
 }
 
 
+static struct nl80211_noise_cache *nl80211_noise_cache_entry(const char *ifname)
+{
+	static struct nl80211_noise_cache cache[NL80211_NOISE_CACHE_SIZE];
+	struct nl80211_noise_cache *e, *oldest = &cache[0];
+	char path[PATH_MAX];
+	int phyidx;
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/phy80211/index", ifname);
+
+	if ((phyidx = nl80211_readint(path)) < 0)
+		return NULL;
+
+	for (e = cache; e < &cache[NL80211_NOISE_CACHE_SIZE]; e++)
+	{
+		if (e->stamp && e->phyidx == phyidx)
+			return e;
+
+		if (e->stamp < oldest->stamp)
+			oldest = e;
+	}
+
+	memset(oldest, 0, sizeof(*oldest));
+	oldest->phyidx = phyidx;
+
+	return oldest;
+}
+
 static int nl80211_get_noise(const char *ifname, int *buf)
 {
 	int8_t noise = 0;
+	struct nl80211_noise_cache *c;
 
 	if (nl80211_request(ifname, NL80211_CMD_GET_SURVEY, NLM_F_DUMP,
 	                    nl80211_get_noise_cb, &noise))
 		goto out;
 
+	/* remember the sample for nl80211_get_noise_cached() */
+	if ((c = nl80211_noise_cache_entry(ifname)) != NULL)
+	{
+		c->noise = noise;
+		c->stamp = iwinfo_msec();
+	}
+
 	*buf = noise;
 	return 0;
 
@@ -1675,6 +1936,23 @@ out:
 	return -1;
 }
 
+/* Like nl80211_get_noise() but reuse a per-radio sample that is younger
+ * than iwinfo_tunables.noise_cache_ms instead of dumping the survey */
+static int nl80211_get_noise_cached(const char *ifname, int *buf)
+{
+	struct nl80211_noise_cache *c;
+
+	if (iwinfo_tunables.noise_cache_ms &&
+	    (c = nl80211_noise_cache_entry(ifname)) != NULL && c->stamp &&
+	    iwinfo_msec() - c->stamp < iwinfo_tunables.noise_cache_ms)
+	{
+		*buf = c->noise;
+		return 0;
+	}
+
+	return nl80211_get_noise(ifname, buf);
+}
+
 static int nl80211_get_quality(const char *ifname, int *buf)
 {
 	int signal;
@@ -2078,13 +2356,10 @@ static void nl80211_parse_rateinfo(struct nlattr **ri,
 	re->is_40mhz = (re->mhz == 40);
 }
 
-static int nl80211_get_survey_cb(struct nl_msg *msg, void *arg)
+static int nl80211_fill_survey(struct nlattr *info,
+                               struct iwinfo_survey_entry *e)
 {
-	struct nl80211_array_buf *arr = arg;
-	struct iwinfo_survey_entry *e = arr->buf;
-	struct nlattr **attr = nl80211_parse(msg);
 	struct nlattr *sinfo[NL80211_SURVEY_INFO_MAX + 1];
-	int rc;
 
 	static const struct nla_policy survey_policy[NL80211_SURVEY_INFO_MAX + 1] = {
 		[NL80211_SURVEY_INFO_FREQUENCY] = { .type = NLA_U32 },
@@ -2096,14 +2371,9 @@ static int nl80211_get_survey_cb(struct nl_msg *msg, void *arg)
 		[NL80211_SURVEY_INFO_TIME_TX] = { .type = NLA_U64   },
 	};
 
-	rc = nla_parse_nested(sinfo, NL80211_SURVEY_INFO_MAX,
-				attr[NL80211_ATTR_SURVEY_INFO],
-				survey_policy);
-	if (rc)
-		return NL_SKIP;
+	if (nla_parse_nested(sinfo, NL80211_SURVEY_INFO_MAX, info, survey_policy))
+		return -1;
 
-	/* advance to end of array */
-	e += arr->count;
 	memset(e, 0, sizeof(*e));
 
 	if (sinfo[NL80211_SURVEY_INFO_FREQUENCY])
@@ -2112,6 +2382,9 @@ static int nl80211_get_survey_cb(struct nl_msg *msg, void *arg)
 	if (sinfo[NL80211_SURVEY_INFO_NOISE])
 		e->noise = nla_get_u8(sinfo[NL80211_SURVEY_INFO_NOISE]);
 
+	if (sinfo[NL80211_SURVEY_INFO_IN_USE])
+		e->in_use = 1;
+
 	if (sinfo[NL80211_SURVEY_INFO_TIME])
 		e->active_time = nla_get_u64(sinfo[NL80211_SURVEY_INFO_TIME]);
 
@@ -2127,10 +2400,118 @@ static int nl80211_get_survey_cb(struct nl_msg *msg, void *arg)
 	if (sinfo[NL80211_SURVEY_INFO_TIME_TX])
 		e->txtime = nla_get_u64(sinfo[NL80211_SURVEY_INFO_TIME_TX]);
 
-	arr->count++;
+	return 0;
+}
+
+static int nl80211_get_survey_cb(struct nl_msg *msg, void *arg)
+{
+	struct nl80211_array_buf *arr = arg;
+	struct iwinfo_survey_entry *e = arr->buf;
+	struct nlattr *info = nl80211_survey_info(msg);
+
+	if (!info || (arr->count + 1) * sizeof(*e) > IWINFO_BUFSIZE)
+		return NL_SKIP;
+
+	/* advance to end of array */
+	e += arr->count;
+
+	if (!nl80211_fill_survey(info, e))
+		arr->count++;
+
+	return NL_SKIP;
+}
+
+struct nl80211_survey_sel {
+	struct iwinfo_survey_entry *e;
+	int mode;
+	/* fallback match for drivers not flagging the channel in use */
+	uint32_t mhz;
+	int found;
+	int radio;
+	int channels;
+	int8_t noise;
+};
+
+/*
+ * The kernel walks every channel of the radio whatever we ask for, but
+ * entries we are not interested in are dismissed after a lookup of the
+ * in-use flag instead of being parsed and copied.
+ */
+static int nl80211_get_survey_sel_cb(struct nl_msg *msg, void *arg)
+{
+	struct nl80211_survey_sel *sel = arg;
+	struct nlattr *info = nl80211_survey_info(msg), *freq;
+	struct iwinfo_survey_entry e;
+	int in_use;
+
+	if (!info)
+		return NL_SKIP;
+
+	in_use = !!nla_find(nla_data(info), nla_len(info),
+	                    NL80211_SURVEY_INFO_IN_USE);
+
+	if (sel->mode == IWINFO_SURVEY_IN_USE)
+	{
+		if (!in_use && sel->mhz &&
+		    (freq = nla_find(nla_data(info), nla_len(info),
+		                     NL80211_SURVEY_INFO_FREQUENCY)) != NULL &&
+		    nla_get_u32(freq) == sel->mhz)
+			in_use = 1;
+
+		if (in_use && !sel->found && !nl80211_fill_survey(info, sel->e))
+			sel->found = 1;
+
+		return NL_SKIP;
+	}
+
+	/* the driver provides totals, channels only matter for the noise */
+	if (sel->radio && !in_use)
+		return NL_SKIP;
+
+	if (nl80211_fill_survey(info, &e))
+		return NL_SKIP;
+
+	if (in_use)
+		sel->noise = e.noise;
+
+	if (!e.mhz)
+	{
+		*sel->e = e;
+		sel->radio = 1;
+	}
+	else if (!sel->radio)
+	{
+		sel->e->active_time   += e.active_time;
+		sel->e->busy_time     += e.busy_time;
+		sel->e->busy_time_ext += e.busy_time_ext;
+		sel->e->rxtime        += e.rxtime;
+		sel->e->txtime        += e.txtime;
+		sel->channels++;
+	}
+
 	return NL_SKIP;
 }
 
+static int nl80211_survey_sel(const char *ifname,
+                              struct nl80211_survey_sel *sel)
+{
+	struct nl80211_msg_conveyor *req;
+
+	req = nl80211_msg(ifname, NL80211_CMD_GET_SURVEY, NLM_F_DUMP);
+
+	if (!req)
+		return -1;
+
+	/* kernels without radio stats send per channel entries only */
+	if (sel->mode == IWINFO_SURVEY_RADIO)
+		NLA_PUT_FLAG(req->msg, NL80211_ATTR_SURVEY_RADIO_STATS);
+
+	return nl80211_send(req, nl80211_get_survey_sel_cb, sel);
+
+nla_put_failure:
+	nl80211_free(req);
+	return -1;
+}
 
 static void plink_state_to_str(char *dst, unsigned state)
 {
@@ -2182,28 +2563,173 @@ static void power_mode_to_str(char *dst, struct nlattr *a)
 	}
 }
 
-static int nl80211_get_assoclist_cb(struct nl_msg *msg, void *arg)
+/* the attribute type is the chain index, chains may be left out */
+static uint8_t nl80211_parse_chains(struct nlattr *attr, int8_t *sig)
 {
-	struct nl80211_array_buf *arr = arg;
-	struct iwinfo_assoclist_entry *e = arr->buf;
-	struct nlattr **attr = nl80211_parse(msg);
-	struct nlattr *sinfo[NL80211_STA_INFO_MAX + 1];
-	struct nlattr *rinfo[NL80211_RATE_INFO_MAX + 1];
-	struct nl80211_sta_flag_update *sta_flags;
+	struct nlattr *chain;
+	uint8_t mask = 0;
+	int rem, idx;
 
-	static const struct nla_policy stats_policy[NL80211_STA_INFO_MAX + 1] = {
-		[NL80211_STA_INFO_INACTIVE_TIME] = { .type = NLA_U32    },
-		[NL80211_STA_INFO_RX_PACKETS]    = { .type = NLA_U32    },
-		[NL80211_STA_INFO_TX_PACKETS]    = { .type = NLA_U32    },
-		[NL80211_STA_INFO_RX_BITRATE]    = { .type = NLA_NESTED },
-		[NL80211_STA_INFO_TX_BITRATE]    = { .type = NLA_NESTED },
-		[NL80211_STA_INFO_SIGNAL]        = { .type = NLA_U8     },
-		[NL80211_STA_INFO_SIGNAL_AVG]    = { .type = NLA_U8     },
-		[NL80211_STA_INFO_RX_BYTES]      = { .type = NLA_U32    },
-		[NL80211_STA_INFO_TX_BYTES]      = { .type = NLA_U32    },
-		[NL80211_STA_INFO_RX_BYTES64]    = { .type = NLA_U64    },
-		[NL80211_STA_INFO_TX_BYTES64]    = { .type = NLA_U64    },
-		[NL80211_STA_INFO_TX_RETRIES]    = { .type = NLA_U32    },
+	nla_for_each_nested(chain, attr, rem)
+	{
+		idx = nla_type(chain);
+
+		if (idx >= IWINFO_MAX_CHAINS)
+			continue;
+
+		sig[idx] = (int8_t)nla_get_u8(chain);
+		mask |= (1 << idx);
+	}
+
+	return mask;
+}
+
+/* summed up, callers aggregate several queues into one */
+static void nl80211_parse_txq(struct nlattr *attr, struct iwinfo_txq_stats *q)
+{
+	struct nlattr *tb[NL80211_TXQ_STATS_MAX + 1];
+
+	static const struct nla_policy txq_policy[NL80211_TXQ_STATS_MAX + 1] = {
+		[NL80211_TXQ_STATS_BACKLOG_BYTES]   = { .type = NLA_U32 },
+		[NL80211_TXQ_STATS_BACKLOG_PACKETS] = { .type = NLA_U32 },
+		[NL80211_TXQ_STATS_FLOWS]           = { .type = NLA_U32 },
+		[NL80211_TXQ_STATS_DROPS]           = { .type = NLA_U32 },
+		[NL80211_TXQ_STATS_ECN_MARKS]       = { .type = NLA_U32 },
+		[NL80211_TXQ_STATS_OVERLIMIT]       = { .type = NLA_U32 },
+		[NL80211_TXQ_STATS_OVERMEMORY]      = { .type = NLA_U32 },
+		[NL80211_TXQ_STATS_COLLISIONS]      = { .type = NLA_U32 },
+		[NL80211_TXQ_STATS_TX_BYTES]        = { .type = NLA_U32 },
+		[NL80211_TXQ_STATS_TX_PACKETS]      = { .type = NLA_U32 },
+	};
+
+	if (nla_parse_nested(tb, NL80211_TXQ_STATS_MAX, attr, txq_policy))
+		return;
+
+#define txq_add(field, id) \
+	if (tb[id]) q->field += nla_get_u32(tb[id])
+
+	txq_add(backlog_bytes, NL80211_TXQ_STATS_BACKLOG_BYTES);
+	txq_add(backlog_packets, NL80211_TXQ_STATS_BACKLOG_PACKETS);
+	txq_add(flows, NL80211_TXQ_STATS_FLOWS);
+	txq_add(drops, NL80211_TXQ_STATS_DROPS);
+	txq_add(ecn_marks, NL80211_TXQ_STATS_ECN_MARKS);
+	txq_add(overlimit, NL80211_TXQ_STATS_OVERLIMIT);
+	txq_add(overmemory, NL80211_TXQ_STATS_OVERMEMORY);
+	txq_add(collisions, NL80211_TXQ_STATS_COLLISIONS);
+	txq_add(tx_bytes, NL80211_TXQ_STATS_TX_BYTES);
+	txq_add(tx_packets, NL80211_TXQ_STATS_TX_PACKETS);
+
+#undef txq_add
+}
+
+/*
+ * The TID stats nest holds one entry per TID, indexed TID + 1, with the
+ * last one (TID 16) counting non-QoS traffic. Fold them into the four
+ * access categories following the 802.1D user priority mapping.
+ */
+static void nl80211_parse_tid_stats(struct nlattr *attr,
+                                    struct iwinfo_ac_stats *ac)
+{
+	static const uint8_t tid2ac[8] = {
+		IWINFO_AC_BE, IWINFO_AC_BK, IWINFO_AC_BK, IWINFO_AC_BE,
+		IWINFO_AC_VI, IWINFO_AC_VI, IWINFO_AC_VO, IWINFO_AC_VO
+	};
+
+	static const struct nla_policy tid_policy[NL80211_TID_STATS_MAX + 1] = {
+		[NL80211_TID_STATS_RX_MSDU]         = { .type = NLA_U64    },
+		[NL80211_TID_STATS_TX_MSDU]         = { .type = NLA_U64    },
+		[NL80211_TID_STATS_TX_MSDU_RETRIES] = { .type = NLA_U64    },
+		[NL80211_TID_STATS_TX_MSDU_FAILED]  = { .type = NLA_U64    },
+		[NL80211_TID_STATS_TXQ_STATS]       = { .type = NLA_NESTED },
+	};
+
+	struct nlattr *tid, *tb[NL80211_TID_STATS_MAX + 1];
+	struct iwinfo_ac_stats *a;
+	int rem, id;
+
+	nla_for_each_nested(tid, attr, rem)
+	{
+		id = nla_type(tid) - 1;
+
+		if (id < 0 || id > 16 ||
+		    nla_parse_nested(tb, NL80211_TID_STATS_MAX, tid, tid_policy))
+			continue;
+
+		a = &ac[(id == 16) ? IWINFO_AC_BE : tid2ac[id & 7]];
+
+		if (tb[NL80211_TID_STATS_RX_MSDU])
+			a->rx_msdu += nla_get_u64(tb[NL80211_TID_STATS_RX_MSDU]);
+
+		if (tb[NL80211_TID_STATS_TX_MSDU])
+			a->tx_msdu += nla_get_u64(tb[NL80211_TID_STATS_TX_MSDU]);
+
+		if (tb[NL80211_TID_STATS_TX_MSDU_RETRIES])
+			a->tx_msdu_retries +=
+				nla_get_u64(tb[NL80211_TID_STATS_TX_MSDU_RETRIES]);
+
+		if (tb[NL80211_TID_STATS_TX_MSDU_FAILED])
+			a->tx_msdu_failed +=
+				nla_get_u64(tb[NL80211_TID_STATS_TX_MSDU_FAILED]);
+
+		if (tb[NL80211_TID_STATS_TXQ_STATS])
+			nl80211_parse_txq(tb[NL80211_TID_STATS_TXQ_STATS], &a->txq);
+	}
+}
+
+static int nl80211_get_txq_stats_cb(struct nl_msg *msg, void *arg)
+{
+	struct nl80211_txq_buf *txq = arg;
+	struct nlattr **tb = nl80211_parse(msg);
+
+	if (tb[NL80211_ATTR_TXQ_STATS])
+	{
+		nl80211_parse_txq(tb[NL80211_ATTR_TXQ_STATS], &txq->stats);
+		txq->found = 1;
+	}
+
+	return NL_SKIP;
+}
+
+static int nl80211_get_txq_stats(const char *ifname, struct iwinfo_txq_stats *buf)
+{
+	char *res;
+	struct nl80211_txq_buf txq = { 0 };
+
+	res = nl80211_phy2ifname(ifname);
+
+	nl80211_request(res ? res : ifname, NL80211_CMD_GET_INTERFACE, 0,
+	                nl80211_get_txq_stats_cb, &txq);
+
+	if (!txq.found)
+		return -1;
+
+	*buf = txq.stats;
+	return 0;
+}
+
+static int nl80211_get_assoclist_cb(struct nl_msg *msg, void *arg)
+{
+	struct nl80211_sta_dump *dump = arg;
+	struct nl80211_array_buf *arr = dump->arr;
+	struct iwinfo_assoclist_entry *e = arr->buf;
+	struct nlattr **attr = nl80211_parse(msg);
+	struct nlattr *sinfo[NL80211_STA_INFO_MAX + 1];
+	struct nlattr *rinfo[NL80211_RATE_INFO_MAX + 1];
+	struct nl80211_sta_flag_update *sta_flags;
+
+	static const struct nla_policy stats_policy[NL80211_STA_INFO_MAX + 1] = {
+		[NL80211_STA_INFO_INACTIVE_TIME] = { .type = NLA_U32    },
+		[NL80211_STA_INFO_RX_PACKETS]    = { .type = NLA_U32    },
+		[NL80211_STA_INFO_TX_PACKETS]    = { .type = NLA_U32    },
+		[NL80211_STA_INFO_RX_BITRATE]    = { .type = NLA_NESTED },
+		[NL80211_STA_INFO_TX_BITRATE]    = { .type = NLA_NESTED },
+		[NL80211_STA_INFO_SIGNAL]        = { .type = NLA_U8     },
+		[NL80211_STA_INFO_SIGNAL_AVG]    = { .type = NLA_U8     },
+		[NL80211_STA_INFO_RX_BYTES]      = { .type = NLA_U32    },
+		[NL80211_STA_INFO_TX_BYTES]      = { .type = NLA_U32    },
+		[NL80211_STA_INFO_RX_BYTES64]    = { .type = NLA_U64    },
+		[NL80211_STA_INFO_TX_BYTES64]    = { .type = NLA_U64    },
+		[NL80211_STA_INFO_TX_RETRIES]    = { .type = NLA_U32    },
 		[NL80211_STA_INFO_TX_FAILED]     = { .type = NLA_U32    },
 		[NL80211_STA_INFO_CONNECTED_TIME]= { .type = NLA_U32    },
 		[NL80211_STA_INFO_RX_DROP_MISC]  = { .type = NLA_U64    },
@@ -2211,6 +2737,19 @@ static int nl80211_get_assoclist_cb(struct nl_msg *msg, void *arg)
 		[NL80211_STA_INFO_STA_FLAGS] =
 			{ .minlen = sizeof(struct nl80211_sta_flag_update) },
 		[NL80211_STA_INFO_EXPECTED_THROUGHPUT]   = { .type = NLA_U32    },
+		[NL80211_STA_INFO_CHAIN_SIGNAL]     = { .type = NLA_NESTED },
+		[NL80211_STA_INFO_CHAIN_SIGNAL_AVG] = { .type = NLA_NESTED },
+		[NL80211_STA_INFO_RX_DURATION]   = { .type = NLA_U64    },
+		[NL80211_STA_INFO_TX_DURATION]   = { .type = NLA_U64    },
+		[NL80211_STA_INFO_AIRTIME_WEIGHT]= { .type = NLA_U16    },
+		[NL80211_STA_INFO_TID_STATS]     = { .type = NLA_NESTED },
+		[NL80211_STA_INFO_RX_MPDUS]      = { .type = NLA_U32    },
+		[NL80211_STA_INFO_FCS_ERROR_COUNT] = { .type = NLA_U32  },
+		[NL80211_STA_INFO_BEACON_LOSS]   = { .type = NLA_U32    },
+		[NL80211_STA_INFO_BEACON_RX]     = { .type = NLA_U64    },
+		[NL80211_STA_INFO_BEACON_SIGNAL_AVG] = { .type = NLA_U8 },
+		[NL80211_STA_INFO_ACK_SIGNAL]    = { .type = NLA_U8     },
+		[NL80211_STA_INFO_ACK_SIGNAL_AVG]= { .type = NLA_U8     },
 		/* mesh */
 		[NL80211_STA_INFO_LLID]          = { .type = NLA_U16	},
 		[NL80211_STA_INFO_PLID]          = { .type = NLA_U16	},
@@ -2227,6 +2766,10 @@ static int nl80211_get_assoclist_cb(struct nl_msg *msg, void *arg)
 		[NL80211_RATE_INFO_SHORT_GI]     = { .type = NLA_FLAG   },
 	};
 
+	/* do not overrun the caller buffer */
+	if ((arr->count + 1) * sizeof(*e) > IWINFO_BUFSIZE)
+		return NL_SKIP;
+
 	/* advance to end of array */
 	e += arr->count;
 	memset(e, 0, sizeof(*e));
@@ -2234,6 +2777,8 @@ static int nl80211_get_assoclist_cb(struct nl_msg *msg, void *arg)
 	if (attr[NL80211_ATTR_MAC])
 		memcpy(e->mac, nla_data(attr[NL80211_ATTR_MAC]), 6);
 
+	strncpy(e->ifname, dump->ifname, sizeof(e->ifname) - 1);
+
 	if (attr[NL80211_ATTR_STA_INFO] &&
 	    !nla_parse_nested(sinfo, NL80211_STA_INFO_MAX,
 	                      attr[NL80211_ATTR_STA_INFO], stats_policy))
@@ -2291,6 +2836,53 @@ static int nl80211_get_assoclist_cb(struct nl_msg *msg, void *arg)
 		if (sinfo[NL80211_STA_INFO_EXPECTED_THROUGHPUT])
 			e->thr = nla_get_u32(sinfo[NL80211_STA_INFO_EXPECTED_THROUGHPUT]);
 
+		/* airtime, in us */
+		if (sinfo[NL80211_STA_INFO_RX_DURATION])
+			e->rx_duration = nla_get_u64(sinfo[NL80211_STA_INFO_RX_DURATION]);
+
+		if (sinfo[NL80211_STA_INFO_TX_DURATION])
+			e->tx_duration = nla_get_u64(sinfo[NL80211_STA_INFO_TX_DURATION]);
+
+		if (sinfo[NL80211_STA_INFO_AIRTIME_WEIGHT])
+			e->airtime_weight = nla_get_u16(sinfo[NL80211_STA_INFO_AIRTIME_WEIGHT]);
+
+		/* link errors */
+		if (sinfo[NL80211_STA_INFO_RX_MPDUS])
+			e->rx_mpdus = nla_get_u32(sinfo[NL80211_STA_INFO_RX_MPDUS]);
+
+		if (sinfo[NL80211_STA_INFO_FCS_ERROR_COUNT])
+			e->fcs_errors = nla_get_u32(sinfo[NL80211_STA_INFO_FCS_ERROR_COUNT]);
+
+		if (sinfo[NL80211_STA_INFO_BEACON_LOSS])
+			e->beacon_loss = nla_get_u32(sinfo[NL80211_STA_INFO_BEACON_LOSS]);
+
+		if (sinfo[NL80211_STA_INFO_BEACON_RX])
+			e->beacon_rx = nla_get_u64(sinfo[NL80211_STA_INFO_BEACON_RX]);
+
+		if (sinfo[NL80211_STA_INFO_BEACON_SIGNAL_AVG])
+			e->beacon_signal_avg =
+				(int8_t)nla_get_u8(sinfo[NL80211_STA_INFO_BEACON_SIGNAL_AVG]);
+
+		if (sinfo[NL80211_STA_INFO_ACK_SIGNAL])
+			e->ack_signal = (int8_t)nla_get_u8(sinfo[NL80211_STA_INFO_ACK_SIGNAL]);
+
+		if (sinfo[NL80211_STA_INFO_ACK_SIGNAL_AVG])
+			e->ack_signal_avg =
+				(int8_t)nla_get_u8(sinfo[NL80211_STA_INFO_ACK_SIGNAL_AVG]);
+
+		/* queueing, per access category */
+		if (sinfo[NL80211_STA_INFO_TID_STATS])
+			nl80211_parse_tid_stats(sinfo[NL80211_STA_INFO_TID_STATS], e->ac);
+
+		/* per antenna */
+		if (sinfo[NL80211_STA_INFO_CHAIN_SIGNAL])
+			e->chains = nl80211_parse_chains(sinfo[NL80211_STA_INFO_CHAIN_SIGNAL],
+			                                 e->chain_signal);
+
+		if (sinfo[NL80211_STA_INFO_CHAIN_SIGNAL_AVG])
+			e->chains_avg = nl80211_parse_chains(sinfo[NL80211_STA_INFO_CHAIN_SIGNAL_AVG],
+			                                     e->chain_signal_avg);
+
 		/* mesh */
 		if (sinfo[NL80211_STA_INFO_LLID])
 			e->llid = nla_get_u16(sinfo[NL80211_STA_INFO_LLID]);
@@ -2362,38 +2954,85 @@ static int nl80211_get_survey(const char *ifname, char *buf, int *len)
 	return 0;
 }
 
-static int nl80211_get_assoclist(const char *ifname, char *buf, int *len)
+static int nl80211_get_survey_mode(const char *ifname, int mode,
+                                   char *buf, int *len)
 {
-	DIR *d;
-	int i, noise = 0;
-	struct dirent *de;
-	struct nl80211_array_buf arr = { .buf = buf, .count = 0 };
-	struct iwinfo_assoclist_entry *e;
+	struct iwinfo_survey_entry *e = (struct iwinfo_survey_entry *)buf;
+	struct nl80211_survey_sel sel = { .e = e, .mode = mode };
+	int mhz;
 
-	if ((d = opendir("/sys/class/net")) != NULL)
+	*len = 0;
+
+	if (mode == IWINFO_SURVEY_ALL)
+		return nl80211_get_survey(ifname, buf, len);
+
+	memset(e, 0, sizeof(*e));
+
+	if (nl80211_survey_sel(ifname, &sel))
+		return -1;
+
+	if (mode == IWINFO_SURVEY_IN_USE)
 	{
-		while ((de = readdir(d)) != NULL)
+		/* find the operating channel by frequency instead */
+		if (!sel.found && !nl80211_get_frequency(ifname, &mhz) && mhz > 0)
 		{
-			if (!strncmp(de->d_name, ifname, strlen(ifname)) &&
-			    (!de->d_name[strlen(ifname)] ||
-			     !strncmp(&de->d_name[strlen(ifname)], ".sta", 4)))
-			{
-				nl80211_request(de->d_name, NL80211_CMD_GET_STATION,
-				                NLM_F_DUMP, nl80211_get_assoclist_cb, &arr);
-			}
+			sel.mhz = mhz;
+
+			if (nl80211_survey_sel(ifname, &sel))
+				return -1;
 		}
 
-		closedir(d);
+		if (!sel.found)
+			return 0;
 
-		if (!nl80211_get_noise(ifname, &noise))
-			for (i = 0, e = arr.buf; i < arr.count; i++, e++)
-				e->noise = noise;
+		e->in_use = 1;
+	}
+	else
+	{
+		if (!sel.radio && !sel.channels)
+			return 0;
 
-		*len = (arr.count * sizeof(struct iwinfo_assoclist_entry));
-		return 0;
+		e->mhz = 0;
+
+		if (!e->noise)
+			e->noise = sel.noise;
 	}
 
-	return -1;
+	*len = sizeof(*e);
+	return 0;
+}
+
+static int nl80211_get_assoclist(const char *ifname, char *buf, int *len)
+{
+	int i, count, noise = 0;
+	const char *names[NL80211_MAX_SUBIFS];
+	void *args[NL80211_MAX_SUBIFS];
+	struct nl80211_sta_dump dumps[NL80211_MAX_SUBIFS];
+	struct nl80211_array_buf arr = { .buf = buf, .count = 0 };
+	struct iwinfo_assoclist_entry *e;
+
+	count = nl80211_get_subifs(ifname, names, NL80211_MAX_SUBIFS);
+
+	if (count < 0)
+		return -1;
+
+	for (i = 0; i < count; i++)
+	{
+		dumps[i].arr = &arr;
+		dumps[i].ifname = names[i];
+		args[i] = &dumps[i];
+	}
+
+	if (count > 0)
+		nl80211_request_multi(names, args, count, NL80211_CMD_GET_STATION,
+		                      NLM_F_DUMP, nl80211_get_assoclist_cb);
+
+	if (!nl80211_get_noise_cached(ifname, &noise))
+		for (i = 0, e = arr.buf; i < arr.count; i++, e++)
+			e->noise = noise;
+
+	*len = (arr.count * sizeof(struct iwinfo_assoclist_entry));
+	return 0;
 }
 
 static int nl80211_get_txpwrlist_cb(struct nl_msg *msg, void *arg)
@@ -2524,66 +3163,102 @@ static void nl80211_get_scancrypto(char *spec, struct iwinfo_crypto_entry *c)
 
 struct nl80211_scanlist {
 	struct iwinfo_scanlist_entry *e;
+	const struct iwinfo_scan_opts *opts;
+	uint32_t max_age;
 	int len;
+	/* entries already in the buffer ahead of e */
+	int offset;
+	/* bitmap of 6 GHz channels seen in Reduced Neighbor Reports */
+	uint32_t *rnr;
+	/* entries expanded from Multiple BSSID elements */
+	int derived;
+	const struct iwinfo_scan_filter *filter;
 };
 
+/* byte size of the entries of one dump, derived duplicates dropped */
+static int nl80211_scanlist_size(const struct nl80211_scanlist *sl)
+{
+	char *start = (char *)(sl->e - sl->len);
+	int len = sl->len * sizeof(*sl->e);
+
+	if (sl->derived)
+		len = iwinfo_scanlist_dedup(start, len);
+
+	if (sl->filter && sl->filter->top)
+		iwinfo_scanlist_sort(start, len);
+
+	return len;
+}
 
-static void nl80211_get_scanlist_ie(struct nlattr **bss,
-                                    struct iwinfo_scanlist_entry *e)
+/* cached results from earlier scans may lie outside a targeted scan */
+static int nl80211_scan_match_freq(const struct iwinfo_scan_opts *opts,
+                                   uint32_t mhz)
 {
-	int ielen = nla_len(bss[NL80211_BSS_INFORMATION_ELEMENTS]);
-	unsigned char *ie = nla_data(bss[NL80211_BSS_INFORMATION_ELEMENTS]);
-	static unsigned char ms_oui[3] = { 0x00, 0x50, 0xf2 };
-	int len;
+	int i;
 
-	while (ielen >= 2 && ielen >= ie[1])
-	{
-		switch (ie[0])
-		{
-		case 0: /* SSID */
-		case 114: /* Mesh ID */
-			if (e->ssid[0] == 0) {
-				len = min(ie[1], IWINFO_ESSID_MAX_SIZE);
-				memcpy(e->ssid, ie + 2, len);
-				e->ssid[len] = 0;
-			}
-			break;
+	if (!opts || !opts->n_freqs)
+		return 1;
 
-		case 48: /* RSN */
-			iwinfo_parse_rsn(&e->crypto, ie + 2, ie[1],
-			                 IWINFO_CIPHER_CCMP, IWINFO_KMGMT_8021x);
-			break;
+	for (i = 0; i < opts->n_freqs; i++)
+		if (opts->freqs[i] == mhz)
+			return 1;
 
-		case 221: /* Vendor */
-			if (ie[1] >= 4 && !memcmp(ie + 2, ms_oui, 3) && ie[5] == 1)
-				iwinfo_parse_rsn(&e->crypto, ie + 6, ie[1] - 4,
-				                 IWINFO_CIPHER_TKIP, IWINFO_KMGMT_PSK);
-			break;
-		case 61: /* HT operation */
-			if (ie[1] >= 3) {
-				e->ht_chan_info.primary_chan = ie[2];
-				e->ht_chan_info.secondary_chan_off = ie[3] & 0x3;
-				e->ht_chan_info.chan_width = (ie[4] & 0x4)>>2;
-			}
-			break;
-		case 192: /* VHT operation */
-			if (ie[1] >= 3) {
-				e->vht_chan_info.chan_width = ie[2];
-				e->vht_chan_info.center_chan_1 = ie[3];
-				e->vht_chan_info.center_chan_2 = ie[4];
-			}
-			break;
-		}
+	return 0;
+}
+
+static const struct iwinfo_scan_filter *
+nl80211_scan_filter(const struct iwinfo_scan_opts *opts)
+{
+	const struct iwinfo_scan_filter *f = opts ? &opts->filter : NULL;
+
+	if (f && (f->ssid[0] || f->bands || f->channel || f->min_signal ||
+	          f->crypto || f->top))
+		return f;
 
-		ielen -= ie[1] + 2;
-		ie += ie[1] + 2;
+	return NULL;
+}
+
+/* reject on the plain attributes before the IEs are looked at */
+static int nl80211_scan_prefilter(const struct iwinfo_scan_filter *f,
+                                  struct nlattr **bss)
+{
+	uint32_t mhz;
+
+	if (bss[NL80211_BSS_FREQUENCY] && (f->bands || f->channel))
+	{
+		mhz = nla_get_u32(bss[NL80211_BSS_FREQUENCY]);
+
+		if (f->bands && !(f->bands & nl80211_freq2band(mhz)))
+			return 0;
+
+		if (f->channel && f->channel != nl80211_freq2channel(mhz))
+			return 0;
 	}
+
+	if (bss[NL80211_BSS_SIGNAL_MBM] && f->min_signal &&
+	    (int32_t)nla_get_u32(bss[NL80211_BSS_SIGNAL_MBM]) / 100 < f->min_signal)
+		return 0;
+
+	return 1;
+}
+
+static void nl80211_scan_note_rnr(const struct iwinfo_ie_view *ies,
+                                  uint32_t *chans)
+{
+	struct iwinfo_rnr_ap aps[16];
+	int i, n = iwinfo_ie_rnr(ies, aps, ARRAY_SIZE(aps));
+
+	for (i = 0; i < n; i++)
+		if (nl80211_freq2band(aps[i].mhz) == IWINFO_BAND_6)
+			chans[aps[i].channel / 32] |= (1U << (aps[i].channel % 32));
 }
 
 static int nl80211_get_scanlist_cb(struct nl_msg *msg, void *arg)
 {
 	int8_t rssi;
 	uint16_t caps;
+	int n = 0;
+	struct iwinfo_ie_view ies;
 
 	struct nl80211_scanlist *sl = arg;
 	struct nlattr **tb = nl80211_parse(msg);
@@ -2616,9 +3291,29 @@ static int nl80211_get_scanlist_cb(struct nl_msg *msg, void *arg)
 	else
 		caps = 0;
 
+	/* do not overrun the caller buffer */
+	if ((sl->offset + sl->len + 1) * sizeof(*sl->e) > IWINFO_BUFSIZE)
+		return NL_SKIP;
+
+	if (bss[NL80211_BSS_FREQUENCY] &&
+	    !nl80211_scan_match_freq(sl->opts,
+	                             nla_get_u32(bss[NL80211_BSS_FREQUENCY])))
+		return NL_SKIP;
+
+	if (sl->max_age && bss[NL80211_BSS_SEEN_MS_AGO] &&
+	    nla_get_u32(bss[NL80211_BSS_SEEN_MS_AGO]) > sl->max_age)
+		return NL_SKIP;
+
+	/* RNR still has to be collected from BSSes filtered out */
+	if (sl->filter && !sl->rnr && !nl80211_scan_prefilter(sl->filter, bss))
+		return NL_SKIP;
+
 	memset(sl->e, 0, sizeof(*sl->e));
 	memcpy(sl->e->mac, nla_data(bss[NL80211_BSS_BSSID]), 6);
 
+	if (bss[NL80211_BSS_SEEN_MS_AGO])
+		sl->e->age = nla_get_u32(bss[NL80211_BSS_SEEN_MS_AGO]);
+
 	if (caps & (1<<1))
 		sl->e->mode = IWINFO_OPMODE_ADHOC;
 	else if (caps & (1<<0))
@@ -2637,7 +3332,14 @@ static int nl80211_get_scanlist_cb(struct nl_msg *msg, void *arg)
 	}
 
 	if (bss[NL80211_BSS_INFORMATION_ELEMENTS])
-		nl80211_get_scanlist_ie(bss, sl->e);
+	{
+		iwinfo_ie_parse(nla_data(bss[NL80211_BSS_INFORMATION_ELEMENTS]),
+		                nla_len(bss[NL80211_BSS_INFORMATION_ELEMENTS]), &ies);
+		iwinfo_ie_fill(&ies, sl->e);
+
+		if (sl->rnr && ies.n_rnr)
+			nl80211_scan_note_rnr(&ies, sl->rnr);
+	}
 
 	if (bss[NL80211_BSS_SIGNAL_MBM])
 	{
@@ -2661,69 +3363,362 @@ static int nl80211_get_scanlist_cb(struct nl_msg *msg, void *arg)
 		sl->e->crypto.pair_ciphers = IWINFO_CIPHER_WEP40 | IWINFO_CIPHER_WEP104;
 	}
 
-	sl->e++;
-	sl->len++;
+	/* nontransmitted BSSes, the kernel may or may not report them too */
+	if (bss[NL80211_BSS_INFORMATION_ELEMENTS] && ies.n_mbssid)
+		n = iwinfo_ie_mbssid(&ies, sl->e, sl->e + 1,
+		                     IWINFO_BUFSIZE / sizeof(*sl->e) -
+		                     (sl->offset + sl->len + 1));
+
+	sl->derived += n;
+
+	if (sl->filter)
+	{
+		n = iwinfo_scanlist_select(sl->e - sl->len, sl->len, sl->filter, 1 + n);
+		sl->e += n - sl->len;
+		sl->len = n;
+	}
+	else
+	{
+		sl->e += 1 + n;
+		sl->len += 1 + n;
+	}
 
 	return NL_SKIP;
 }
 
-static int nl80211_get_scanlist_nl(const char *ifname, char *buf, int *len)
+static int nl80211_put_scan_opts(struct nl_msg *msg,
+                                 const struct iwinfo_scan_opts *opts,
+                                 uint32_t flags)
 {
-	struct nl80211_scanlist sl = { .e = (struct iwinfo_scanlist_entry *)buf };
+	struct nlattr *nest;
+	int i;
 
-	if (nl80211_request(ifname, NL80211_CMD_TRIGGER_SCAN, 0, NULL, NULL))
-		goto out;
+	if (opts)
+	{
+		if (opts->n_freqs)
+		{
+			if (!(nest = nla_nest_start(msg, NL80211_ATTR_SCAN_FREQUENCIES)))
+				goto nla_put_failure;
 
-	if (nl80211_wait("nl80211", "scan",
-	                 NL80211_CMD_NEW_SCAN_RESULTS, NL80211_CMD_SCAN_ABORTED))
-		goto out;
+			for (i = 0; i < opts->n_freqs; i++)
+				NLA_PUT_U32(msg, i + 1, opts->freqs[i]);
 
-	if (nl80211_request(ifname, NL80211_CMD_GET_SCAN, NLM_F_DUMP,
-	                    nl80211_get_scanlist_cb, &sl))
-		goto out;
+			nla_nest_end(msg, nest);
+		}
+
+		/* without any SSID the scan is passive, the empty wildcard SSID
+		 * probes for every network */
+		if (!(opts->flags & IWINFO_SCAN_F_PASSIVE))
+		{
+			if (!(nest = nla_nest_start(msg, NL80211_ATTR_SCAN_SSIDS)))
+				goto nla_put_failure;
+
+			for (i = 0; i < opts->n_ssids; i++)
+				NLA_PUT(msg, i + 1, strlen(opts->ssids[i]), opts->ssids[i]);
+
+			if (!opts->n_ssids)
+				NLA_PUT(msg, 1, 0, "");
+
+			nla_nest_end(msg, nest);
+		}
+
+		if (opts->dwell)
+			NLA_PUT_U16(msg, NL80211_ATTR_MEASUREMENT_DURATION, opts->dwell);
+
+		if (opts->flags & IWINFO_SCAN_F_LOW_PRIORITY)
+			flags |= NL80211_SCAN_FLAG_LOW_PRIORITY;
+
+		if (opts->flags & IWINFO_SCAN_F_LOW_SPAN)
+			flags |= NL80211_SCAN_FLAG_LOW_SPAN;
+
+		if (opts->flags & IWINFO_SCAN_F_FLUSH)
+			flags |= NL80211_SCAN_FLAG_FLUSH;
+	}
+
+	if (flags)
+		NLA_PUT_U32(msg, NL80211_ATTR_SCAN_FLAGS, flags);
 
-	*len = sl.len * sizeof(struct iwinfo_scanlist_entry);
 	return 0;
 
-out:
-	*len = 0;
+nla_put_failure:
 	return -1;
 }
 
-static int wpasupp_ssid_decode(const char *in, char *out, int outlen)
+static int nl80211_trigger_scan(const char *ifname,
+                                const struct iwinfo_scan_opts *opts,
+                                uint32_t flags)
 {
-#define hex(x) \
-	(((x) >= 'a') ? ((x) - 'a' + 10) : \
-		(((x) >= 'A') ? ((x) - 'A' + 10) : ((x) - '0')))
+	struct nl80211_msg_conveyor *req;
 
-	int len = 0;
+	req = nl80211_msg(ifname, NL80211_CMD_TRIGGER_SCAN, 0);
 
-	while (*in)
+	if (!req)
+		return -ENOMEM;
+
+	if (nl80211_put_scan_opts(req->msg, opts, flags))
 	{
-		if (len + 1 >= outlen)
-			break;
+		nl80211_free(req);
+		return -ENOBUFS;
+	}
 
-		switch (*in)
-		{
-		case '\\':
-			in++;
-			switch (*in)
-			{
-			case 'n':
-				out[len++] = '\n'; in++;
-				break;
+	return nl80211_send(req, NULL, NULL);
+}
 
-			case 'r':
-				out[len++] = '\r'; in++;
-				break;
+/*
+ * Upper bound for a scan to complete, from the channels it will visit.
+ * Channels where the regulatory domain forbids probing are scanned
+ * passively and take longer.
+ */
+static int nl80211_get_freqlist(const char *ifname, char *buf, int *len);
 
-			case 't':
-				out[len++] = '\t'; in++;
-				break;
+static uint32_t nl80211_scan_timeout(const char *ifname,
+                                     const struct iwinfo_scan_opts *opts,
+                                     uint32_t flags)
+{
+	struct iwinfo_freqlist_entry *f;
+	uint32_t per, active, passive, timeout = NL80211_SCAN_SLACK;
+	int i, len = 0;
+	char *buf;
 
-			case 'e':
-				out[len++] = '\033'; in++;
-				break;
+	passive = NL80211_SCAN_PASSIVE_TIME;
+	active = (opts && (opts->flags & IWINFO_SCAN_F_PASSIVE))
+		? passive : NL80211_SCAN_ACTIVE_TIME;
+
+	if (opts && opts->dwell)
+	{
+		per = opts->dwell * 1024 / 1000 + NL80211_SCAN_ACTIVE_TIME / 2;
+
+		if (per > active)
+			active = per;
+
+		if (per > passive)
+			passive = per;
+	}
+
+	if ((flags & NL80211_SCAN_FLAG_AP) ||
+	    (opts && (opts->flags & IWINFO_SCAN_F_LOW_PRIORITY)))
+	{
+		active += NL80211_SCAN_HOME_TIME;
+		passive += NL80211_SCAN_HOME_TIME;
+	}
+
+	buf = malloc(IWINFO_BUFSIZE);
+
+	if (!buf || nl80211_get_freqlist(ifname, buf, &len) || !len)
+	{
+		free(buf);
+		return timeout + NL80211_SCAN_MAX_CHANNELS * passive;
+	}
+
+	for (i = 0; i < len / (int)sizeof(*f); i++)
+	{
+		f = (struct iwinfo_freqlist_entry *)buf + i;
+
+		if (!nl80211_scan_match_freq(opts, f->mhz))
+			continue;
+
+		timeout += (f->flags & IWINFO_FREQ_NO_IR) ? passive : active;
+	}
+
+	free(buf);
+
+	return timeout;
+}
+
+/*
+ * One scan request and the dump of its results. The results are placed
+ * behind the *len bytes already in buf, *len is updated to the total.
+ * Returns 0 or a negative errno, -ECANCELED if the scan was aborted.
+ */
+static int nl80211_scan_pass(const char *ifname,
+                             const struct iwinfo_scan_opts *opts,
+                             uint32_t flags, uint32_t *rnr,
+                             char *buf, int *len)
+{
+	struct nl80211_scanlist sl = {
+		.e = (struct iwinfo_scanlist_entry *)(buf + *len),
+		.opts = opts,
+		.offset = *len / sizeof(struct iwinfo_scanlist_entry),
+		.rnr = rnr,
+		.filter = nl80211_scan_filter(opts)
+	};
+	uint64_t deadline;
+	int err;
+
+	/* the freqlist dump runs on the socket that may already be subscribed
+	 * to the scan group, do it before an event can arrive and be dropped */
+	deadline = iwinfo_msec() + nl80211_scan_timeout(ifname, opts, flags);
+
+	if ((err = nl80211_trigger_scan(ifname, opts, flags)) != 0)
+		return (err < 0) ? err : -EIO;
+
+	err = nl80211_wait("nl80211", "scan", deadline,
+	                   NL80211_CMD_NEW_SCAN_RESULTS, NL80211_CMD_SCAN_ABORTED);
+
+	if (err == NL80211_CMD_SCAN_ABORTED)
+		return -ECANCELED;
+
+	/* don't leave the scan running, the next one would get -EBUSY */
+	if (err == -ETIMEDOUT &&
+	    !nl80211_request(ifname, NL80211_CMD_ABORT_SCAN, 0, NULL, NULL))
+		nl80211_wait("nl80211", "scan", iwinfo_msec() + NL80211_SCAN_ABORT_TIME,
+		             NL80211_CMD_NEW_SCAN_RESULTS, NL80211_CMD_SCAN_ABORTED);
+
+	if (err < 0)
+		return err;
+
+	if ((err = nl80211_request(ifname, NL80211_CMD_GET_SCAN, NLM_F_DUMP,
+	                           nl80211_get_scanlist_cb, &sl)) != 0)
+		return (err < 0) ? err : -EIO;
+
+	*len += nl80211_scanlist_size(&sl);
+	return 0;
+}
+
+/*
+ * Sweeping all 6 GHz channels dominates the scan time of tri-band
+ * radios. Co-located 2.4/5 GHz APs advertise their 6 GHz siblings in
+ * Reduced Neighbor Reports, so scan those bands first and follow up on
+ * the advertised 6 GHz channels and the preferred scanning channels
+ * (PSC, every fourth 20 MHz channel starting at 5) only.
+ */
+static int nl80211_get_scanlist_rnr(const char *ifname,
+                                    const struct iwinfo_scan_opts *opts,
+                                    uint32_t flags, char *buf, int *len)
+{
+	struct iwinfo_freqlist_entry *f;
+	struct iwinfo_scan_opts pass = *opts;
+	uint32_t rnr[8] = { 0 };
+	int i, err, flen = 0, n6 = 0, full = 0;
+	char *fbuf;
+
+	pass.flags &= ~IWINFO_SCAN_F_RNR_6GHZ;
+	pass.n_freqs = 0;
+
+	if (!(fbuf = malloc(IWINFO_BUFSIZE)) ||
+	    nl80211_get_freqlist(ifname, fbuf, &flen))
+		flen = 0;
+
+	for (i = 0; i < flen / (int)sizeof(*f); i++)
+	{
+		f = (struct iwinfo_freqlist_entry *)fbuf + i;
+
+		if (!nl80211_scan_match_freq(opts, f->mhz))
+			continue;
+
+		if (nl80211_freq2band(f->mhz) == IWINFO_BAND_6)
+			n6++;
+		else if (pass.n_freqs < IWINFO_SCAN_MAX_FREQS)
+			pass.freqs[pass.n_freqs++] = f->mhz;
+		else
+			full = 1;
+	}
+
+	*len = 0;
+
+	/* nothing to gain without 6 GHz channels, or with too many others
+	 * to name in a single request */
+	if (!n6 || !pass.n_freqs || full)
+	{
+		free(fbuf);
+		return nl80211_scan_pass(ifname, opts, flags, NULL, buf, len);
+	}
+
+	if ((err = nl80211_scan_pass(ifname, &pass, flags, rnr, buf, len)) != 0)
+	{
+		free(fbuf);
+		*len = 0;
+		return err;
+	}
+
+	for (i = 0, pass.n_freqs = 0; i < flen / (int)sizeof(*f); i++)
+	{
+		f = (struct iwinfo_freqlist_entry *)fbuf + i;
+
+		if (!nl80211_scan_match_freq(opts, f->mhz) ||
+		    nl80211_freq2band(f->mhz) != IWINFO_BAND_6 ||
+		    pass.n_freqs >= IWINFO_SCAN_MAX_FREQS)
+			continue;
+
+		if ((f->channel % 16) == 5 ||
+		    (rnr[f->channel / 32] & (1U << (f->channel % 32))))
+			pass.freqs[pass.n_freqs++] = f->mhz;
+	}
+
+	free(fbuf);
+
+	/* the first pass results are in already */
+	pass.flags &= ~IWINFO_SCAN_F_FLUSH;
+
+	/* keep the first pass results if the second one fails */
+	if (pass.n_freqs)
+	{
+		i = *len;
+
+		if (nl80211_scan_pass(ifname, &pass, flags, NULL, buf, len))
+			*len = i;
+		else if (opts->filter.top)
+			*len = iwinfo_scanlist_filter(buf, *len, &opts->filter);
+	}
+
+	return 0;
+}
+
+/* returns 0 or a negative errno, see nl80211_scan_pass() */
+static int nl80211_get_scanlist_nl(const char *ifname,
+                                   const struct iwinfo_scan_opts *opts,
+                                   uint32_t flags, char *buf, int *len)
+{
+	int err;
+
+	*len = 0;
+
+	if (opts && (opts->flags & IWINFO_SCAN_F_RNR_6GHZ))
+		return nl80211_get_scanlist_rnr(ifname, opts, flags, buf, len);
+
+	if ((err = nl80211_scan_pass(ifname, opts, flags, NULL, buf, len)) != 0)
+	{
+		*len = 0;
+		return err;
+	}
+
+	return 0;
+}
+
+static int wpasupp_ssid_decode(const char *in, char *out, int outlen)
+{
+#define hex(x) \
+	(((x) >= 'a') ? ((x) - 'a' + 10) : \
+		(((x) >= 'A') ? ((x) - 'A' + 10) : ((x) - '0')))
+
+	int len = 0;
+
+	while (*in)
+	{
+		if (len + 1 >= outlen)
+			break;
+
+		switch (*in)
+		{
+		case '\\':
+			in++;
+			switch (*in)
+			{
+			case 'n':
+				out[len++] = '\n'; in++;
+				break;
+
+			case 'r':
+				out[len++] = '\r'; in++;
+				break;
+
+			case 't':
+				out[len++] = '\t'; in++;
+				break;
+
+			case 'e':
+				out[len++] = '\033'; in++;
+				break;
 
 			case 'x':
 				if (isxdigit(*(in+1)) && isxdigit(*(in+2)))
@@ -2749,163 +3744,359 @@ static int wpasupp_ssid_decode(const char *in, char *out, int outlen)
 	return len;
 }
 
-static int nl80211_get_scanlist_wpactl(const char *ifname, char *buf, int *len)
+/* dwell time and scan flags have no wpa_supplicant equivalent */
+static int nl80211_wpactl_scan_cmd(const struct iwinfo_scan_opts *opts,
+                                   char *cmd, int len)
 {
-	int sock, qmax, rssi, tries, count = -1, ready = 0;
-	char *pos, *line, *bssid, *freq, *signal, *flags, *ssid, reply[4096];
-	struct sockaddr_un local = { 0 };
-	struct iwinfo_scanlist_entry *e = (struct iwinfo_scanlist_entry *)buf;
+	int i, j, n;
 
-	sock = nl80211_wpactl_connect(ifname, &local);
+	n = snprintf(cmd, len, "SCAN");
 
-	if (sock < 0)
-		return sock;
+	if (!opts)
+		return n;
 
-	send(sock, "ATTACH", 6, 0);
-	send(sock, "SCAN", 4, 0);
+	for (i = 0; i < opts->n_freqs && n < len; i++)
+		n += snprintf(cmd + n, len - n, "%s%u",
+		              i ? "," : " freq=", opts->freqs[i]);
 
-	/*
-	 * wait for scan results:
-	 *   nl80211_wpactl_recv() will use a timeout of 256ms and we need to scan
-	 *   72 channels at most. We'll also receive two "OK" messages acknowledging
-	 *   the "ATTACH" and "SCAN" commands and the driver might need a bit extra
-	 *   time to process the results, so try 72 + 2 + 1 times.
-	 */
-	for (tries = 0; tries < 75; tries++)
+	if ((opts->flags & IWINFO_SCAN_F_PASSIVE) && n < len)
+		n += snprintf(cmd + n, len - n, " passive=1");
+
+	for (i = 0; i < opts->n_ssids && n < len; i++)
+	{
+		n += snprintf(cmd + n, len - n, " ssid ");
+
+		for (j = 0; opts->ssids[i][j] && n < len; j++)
+			n += snprintf(cmd + n, len - n, "%02x",
+			              (uint8_t)opts->ssids[i][j]);
+	}
+
+	return (n < len) ? n : -1;
+}
+
+/*
+ * wpa_supplicant replies are limited to 4 KB, which SCAN_RESULTS exceeds
+ * in dense environments. The BSS table is therefore read in pages with
+ * "BSS RANGE=<id>-", each reply holding as many complete entries as fit,
+ * separated by "====". Versions without RANGE support are walked with
+ * "BSS FIRST" / "BSS NEXT-<id>" one entry at a time.
+ */
+#define WPACTL_BSS_MASK_ID		(1 << 0)
+#define WPACTL_BSS_MASK_BSSID		(1 << 1)
+#define WPACTL_BSS_MASK_FREQ		(1 << 2)
+#define WPACTL_BSS_MASK_CAPS		(1 << 4)
+#define WPACTL_BSS_MASK_LEVEL		(1 << 7)
+#define WPACTL_BSS_MASK_AGE		(1 << 9)
+#define WPACTL_BSS_MASK_IE		(1 << 10)
+#define WPACTL_BSS_MASK_FLAGS		(1 << 11)
+#define WPACTL_BSS_MASK_SSID		(1 << 12)
+#define WPACTL_BSS_MASK_DELIM		(1 << 17)
+
+#define WPACTL_BSS_MASK \
+	(WPACTL_BSS_MASK_ID | WPACTL_BSS_MASK_BSSID | WPACTL_BSS_MASK_FREQ | \
+	 WPACTL_BSS_MASK_CAPS | WPACTL_BSS_MASK_LEVEL | WPACTL_BSS_MASK_AGE | \
+	 WPACTL_BSS_MASK_IE | WPACTL_BSS_MASK_FLAGS | WPACTL_BSS_MASK_SSID | \
+	 WPACTL_BSS_MASK_DELIM)
+
+static int nl80211_wpactl_bss_cmd(int sock, const char *cmd, char *reply, int rlen)
+{
+	uint64_t deadline = iwinfo_msec() + NL80211_WPACTL_TIMEOUT;
+	int len;
+
+	if (send(sock, cmd, strlen(cmd), 0) < 0)
+		return -1;
+
+	/* skip event notifications interleaved with the reply */
+	do {
+		len = nl80211_wpactl_recv(sock, reply, rlen, deadline);
+	} while (len > 0 && reply[0] == '<');
+
+	if (len < 0 || !strncmp(reply, "FAIL", 4))
+		return -1;
+
+	return len;
+}
+
+/* parse one "key=value" block, returns the BSS id or -1 */
+static int nl80211_wpactl_parse_bss(char *block, int qmax,
+                                    const struct iwinfo_scan_opts *opts,
+                                    struct iwinfo_scanlist_entry *e, int *valid)
+{
+	int id = -1, rssi, i, ielen = 0;
+	unsigned int mac[6];
+	uint16_t caps = 0;
+	char *line, *val, *pos, *ie = NULL, *flags = NULL, *ssid = NULL;
+	unsigned char iebuf[2048];
+	struct iwinfo_ie_view ies;
+
+	memset(e, 0, sizeof(*e));
+
+	for (line = strtok_r(block, "\n", &pos);
+	     line != NULL;
+	     line = strtok_r(NULL, "\n", &pos))
 	{
-		if (nl80211_wpactl_recv(sock, reply, sizeof(reply)) <= 0)
+		if (!(val = strchr(line, '=')))
 			continue;
 
-		/* got an event notification */
-		if (reply[0] == '<')
-		{
-			/* scan results are ready */
-			if (strstr(reply, "CTRL-EVENT-SCAN-RESULTS"))
-			{
-				/* send "SCAN_RESULTS" command */
-				ready = (send(sock, "SCAN_RESULTS", 12, 0) == 12);
-				break;
-			}
+		*val++ = 0;
+
+		if (!strcmp(line, "id"))
+			id = atoi(val);
+		else if (!strcmp(line, "bssid") &&
+		         sscanf(val, "%02x:%02x:%02x:%02x:%02x:%02x",
+		                &mac[0], &mac[1], &mac[2],
+		                &mac[3], &mac[4], &mac[5]) == 6)
+			for (i = 0; i < 6; i++)
+				e->mac[i] = mac[i];
+		else if (!strcmp(line, "freq"))
+			e->mhz = atoi(val);
+		else if (!strcmp(line, "capabilities"))
+			caps = strtoul(val, NULL, 16);
+		else if (!strcmp(line, "level"))
+			e->signal = atoi(val);
+		else if (!strcmp(line, "age"))
+			e->age = atoi(val) * 1000;
+		else if (!strcmp(line, "ie"))
+			ie = val;
+		else if (!strcmp(line, "flags"))
+			flags = val;
+		else if (!strcmp(line, "ssid"))
+			ssid = val;
+	}
 
-			/* is another unrelated event, retry */
-			tries--;
-		}
+	*valid = (id >= 0 && e->mhz && nl80211_scan_match_freq(opts, e->mhz));
 
-		/* scanning already in progress, keep awaiting results */
-		else if (!strcmp(reply, "FAIL-BUSY\n"))
-		{
-			tries--;
-		}
+	if (!*valid)
+		return id;
+
+	/* Mode */
+	if (flags && strstr(flags, "[MESH]"))
+		e->mode = IWINFO_OPMODE_MESHPOINT;
+	else if (flags && strstr(flags, "[IBSS]"))
+		e->mode = IWINFO_OPMODE_ADHOC;
+	else
+		e->mode = IWINFO_OPMODE_MASTER;
+
+	/* Channel */
+	e->band = nl80211_freq2band(e->mhz);
+	e->channel = nl80211_freq2channel(e->mhz);
+
+	/* Signal and quality, see the wext compat range below */
+	rssi = (int8_t)e->signal;
+
+	if (rssi < 0)
+	{
+		if (rssi < -110)
+			rssi = -110;
+		else if (rssi > -40)
+			rssi = -40;
+
+		e->quality = (rssi + 110);
+	}
+	else
+	{
+		e->quality = rssi;
+	}
 
-		/* another failure, abort */
-		else if (!strncmp(reply, "FAIL-", 5))
+	e->quality_max = qmax;
+
+	/* Information elements, same detail as the netlink results */
+	if (ie)
+	{
+		for (; isxdigit(ie[0]) && isxdigit(ie[1]) &&
+		       ielen < (int)sizeof(iebuf); ie += 2)
+			iebuf[ielen++] = hex(ie[0]) * 16 + hex(ie[1]);
+
+		if (caps & (1<<4))
+			e->crypto.enabled = 1;
+
+		iwinfo_ie_parse(iebuf, ielen, &ies);
+		iwinfo_ie_fill(&ies, e);
+
+		if (e->crypto.enabled && !e->crypto.wpa_version)
 		{
-			break;
+			e->crypto.auth_algs    = IWINFO_AUTH_OPEN | IWINFO_AUTH_SHARED;
+			e->crypto.pair_ciphers = IWINFO_CIPHER_WEP40 | IWINFO_CIPHER_WEP104;
 		}
 	}
+	else if (flags)
+	{
+		nl80211_get_scancrypto(flags, &e->crypto);
+	}
+
+	if (!e->ssid[0] && ssid)
+		wpasupp_ssid_decode(ssid, e->ssid, sizeof(e->ssid));
+
+	return id;
+}
+
+static int nl80211_wpactl_get_bss(int sock, const char *ifname,
+                                  const struct iwinfo_scan_opts *opts,
+                                  char *buf, int *len)
+{
+	int id, rlen, qmax, valid, advanced, count = 0, next = 0, range = 1;
+	char cmd[64], *block, *end, reply[8192];
+	struct iwinfo_scanlist_entry *e = (struct iwinfo_scanlist_entry *)buf;
+	const struct iwinfo_scan_filter *f = nl80211_scan_filter(opts);
+
+	nl80211_get_quality_max(ifname, &qmax);
 
-	/* receive and parse scan results if the wait above didn't time out */
-	while (ready && nl80211_wpactl_recv(sock, reply, sizeof(reply)) > 0)
+	while ((count + 1) * sizeof(*e) <= IWINFO_BUFSIZE)
 	{
-		/* received an event notification, receive again */
-		if (reply[0] == '<')
+		if (range)
+			snprintf(cmd, sizeof(cmd), "BSS RANGE=%d- MASK=0x%x",
+			         next, WPACTL_BSS_MASK);
+		else if (next)
+			snprintf(cmd, sizeof(cmd), "BSS NEXT-%d MASK=0x%x",
+			         next - 1, WPACTL_BSS_MASK);
+		else
+			snprintf(cmd, sizeof(cmd), "BSS FIRST MASK=0x%x",
+			         WPACTL_BSS_MASK);
+
+		rlen = nl80211_wpactl_bss_cmd(sock, cmd, reply, sizeof(reply));
+
+		/*
+		 * Versions without RANGE support take the argument as id 0 and
+		 * reply with a single undelimited entry, or with nothing at all
+		 * once id 0 is gone; walk the list instead. A RANGE reply past
+		 * the last entry is empty too, the walk then simply ends.
+		 */
+		if (range && (rlen <= 0 || !strstr(reply, "====\n")))
+		{
+			range = 0;
 			continue;
+		}
 
-		nl80211_get_quality_max(ifname, &qmax);
+		if (rlen <= 0)
+			break;
 
-		for (line = strtok_r(reply, "\n", &pos);
-		     line != NULL;
-		     line = strtok_r(NULL, "\n", &pos))
+		for (block = reply, advanced = 0;
+		     block && *block && (count + 1) * sizeof(*e) <= IWINFO_BUFSIZE;
+		     block = end)
 		{
-			/* skip header line */
-			if (count < 0)
+			if ((end = strstr(block, "====\n")) != NULL)
 			{
-				count++;
-				continue;
+				*end = 0;
+				end += 5;
 			}
 
-			bssid  = strtok(line, "\t");
-			freq   = strtok(NULL, "\t");
-			signal = strtok(NULL, "\t");
-			flags  = strtok(NULL, "\t");
-			ssid   = strtok(NULL, "\n");
-
-			if (!bssid || !freq || !signal || !flags)
+			if ((id = nl80211_wpactl_parse_bss(block, qmax, opts, e, &valid)) < next)
 				continue;
 
-			/* BSSID */
-			e->mac[0] = strtol(&bssid[0],  NULL, 16);
-			e->mac[1] = strtol(&bssid[3],  NULL, 16);
-			e->mac[2] = strtol(&bssid[6],  NULL, 16);
-			e->mac[3] = strtol(&bssid[9],  NULL, 16);
-			e->mac[4] = strtol(&bssid[12], NULL, 16);
-			e->mac[5] = strtol(&bssid[15], NULL, 16);
-
-			/* SSID */
-			if (ssid)
-				wpasupp_ssid_decode(ssid, e->ssid, sizeof(e->ssid));
-			else
-				e->ssid[0] = 0;
-
-			/* Mode */
-			if (strstr(flags, "[MESH]"))
-				e->mode = IWINFO_OPMODE_MESHPOINT;
-			else if (strstr(flags, "[IBSS]"))
-				e->mode = IWINFO_OPMODE_ADHOC;
-			else
-				e->mode = IWINFO_OPMODE_MASTER;
-
-			/* Channel */
-			e->mhz = atoi(freq);
-			e->band = nl80211_freq2band(e->mhz);
-			e->channel = nl80211_freq2channel(e->mhz);
-
-			/* Signal */
-			rssi = atoi(signal);
-			e->signal = rssi;
-
-			/* Quality */
-			if (rssi < 0)
-			{
-				/* The cfg80211 wext compat layer assumes a signal range
-				 * of -110 dBm to -40 dBm, the quality value is derived
-				 * by adding 110 to the signal level */
-				if (rssi < -110)
-					rssi = -110;
-				else if (rssi > -40)
-					rssi = -40;
-
-				e->quality = (rssi + 110);
-			}
-			else
+			next = id + 1;
+			advanced = 1;
+
+			if (valid)
 			{
-				e->quality = rssi;
+				count = iwinfo_scanlist_select((struct iwinfo_scanlist_entry *)buf,
+				                               count, f, 1);
+				e = (struct iwinfo_scanlist_entry *)buf + count;
 			}
+		}
 
-			/* Max. Quality */
-			e->quality_max = qmax;
+		if (!advanced)
+			break;
+	}
 
-			/* Crypto */
-			nl80211_get_scancrypto(flags, &e->crypto);
+	*len = count * sizeof(*e);
 
-			count++;
-			e++;
-		}
+	if (f && f->top)
+		iwinfo_scanlist_sort(buf, *len);
 
-		*len = count * sizeof(struct iwinfo_scanlist_entry);
-		break;
+	return count;
+}
+
+static int nl80211_get_scanlist_wpactl(const char *ifname,
+                                       const struct iwinfo_scan_opts *opts,
+                                       char *buf, int *len)
+{
+	int sock, cmdlen, count = -1, ready = 0;
+	uint64_t deadline;
+	char reply[4096];
+	char cmd[IWINFO_SCAN_MAX_FREQS * 5 +
+	         IWINFO_SCAN_MAX_SSIDS * (IWINFO_ESSID_MAX_SIZE * 2 + 6) + 32];
+	struct sockaddr_un local = { 0 };
+
+	if ((cmdlen = nl80211_wpactl_scan_cmd(opts, cmd, sizeof(cmd))) < 0)
+		return -1;
+
+	/* before the scan is started, like nl80211_scan_pass() */
+	deadline = iwinfo_msec() + nl80211_scan_timeout(ifname, opts, 0);
+
+	sock = nl80211_wpactl_connect(ifname, &local);
+
+	if (sock < 0)
+		return sock;
+
+	send(sock, "ATTACH", 6, 0);
+
+	if (opts && (opts->flags & IWINFO_SCAN_F_FLUSH))
+		send(sock, "BSS_FLUSH 0", 11, 0);
+
+	send(sock, cmd, cmdlen, 0);
+
+	/*
+	 * Wait for the scan to finish. Besides the events we receive the
+	 * replies to ATTACH and SCAN; FAIL-BUSY means a scan is already
+	 * running, whose results are as good as ours.
+	 */
+	while (nl80211_wpactl_recv(sock, reply, sizeof(reply), deadline) >= 0)
+	{
+		if (reply[0] == '<')
+		{
+			if (strstr(reply, "CTRL-EVENT-SCAN-RESULTS"))
+			{
+				ready = 1;
+				break;
+			}
+
+			if (strstr(reply, "CTRL-EVENT-SCAN-FAILED"))
+				break;
+		}
+		else if (!strncmp(reply, "FAIL", 4) && strcmp(reply, "FAIL-BUSY\n"))
+		{
+			break;
+		}
 	}
 
+	/* page through the BSS table if the wait above didn't time out */
+	if (ready)
+		count = nl80211_wpactl_get_bss(sock, ifname, opts, buf, len);
+
 	close(sock);
 	unlink(local.sun_path);
 
 	return (count >= 0) ? 0 : -1;
 }
 
-static int nl80211_get_scanlist(const char *ifname, char *buf, int *len)
+static int nl80211_get_wiphy_features_cb(struct nl_msg *msg, void *arg)
+{
+	uint32_t *features = arg;
+	struct nlattr **tb = nl80211_parse(msg);
+
+	if (tb[NL80211_ATTR_FEATURE_FLAGS])
+		*features |= nla_get_u32(tb[NL80211_ATTR_FEATURE_FLAGS]);
+
+	return NL_SKIP;
+}
+
+static uint32_t nl80211_get_wiphy_features(const char *ifname)
+{
+	uint32_t features = 0;
+
+	nl80211_request(ifname, NL80211_CMD_GET_WIPHY, 0,
+	                nl80211_get_wiphy_features_cb, &features);
+
+	return features;
+}
+
+static int nl80211_scan_iface(const char *ifname,
+                              const struct iwinfo_scan_opts *opts,
+                              char *buf, int *len, int *method)
 {
 	char *res;
-	int rv, mode;
+	int rv, mode = IWINFO_OPMODE_UNKNOWN;
+	uint32_t flags = 0;
 
 	*len = 0;
 
@@ -2915,85 +4106,481 @@ static int nl80211_get_scanlist(const char *ifname, char *buf, int *len)
 		/* Reuse existing interface */
 		if ((res = nl80211_phy2ifname(ifname)) != NULL)
 		{
-			return nl80211_get_scanlist(res, buf, len);
+			return nl80211_scan_iface(res, opts, buf, len, method);
 		}
 
 		/* Need to spawn a temporary iface for scanning */
 		else if ((res = nl80211_ifadd(ifname)) != NULL)
 		{
-			rv = nl80211_get_scanlist(res, buf, len);
+			rv = nl80211_scan_iface(res, opts, buf, len, method);
 			nl80211_ifdel(res);
+			*method = IWINFO_SCAN_METHOD_TMP_IFACE;
 			return rv;
 		}
 	}
 
 	/* WPA supplicant */
-	if (!nl80211_get_scanlist_wpactl(ifname, buf, len))
+	if (!nl80211_get_scanlist_wpactl(ifname, opts, buf, len))
 	{
+		*method = IWINFO_SCAN_METHOD_WPA_SUPPLICANT;
 		return 0;
 	}
 
 	/* station / ad-hoc / monitor scan */
 	else if (!nl80211_get_mode(ifname, &mode) &&
 	         (mode == IWINFO_OPMODE_ADHOC ||
-	          mode == IWINFO_OPMODE_MASTER ||
 	          mode == IWINFO_OPMODE_CLIENT ||
 	          mode == IWINFO_OPMODE_MONITOR) &&
 	         iwinfo_ifup(ifname))
 	{
-		return nl80211_get_scanlist_nl(ifname, buf, len);
+		*method = IWINFO_SCAN_METHOD_DIRECT;
+		return nl80211_get_scanlist_nl(ifname, opts, 0, buf, len);
 	}
 
-	/* AP scan */
-	else
+	/* AP scan, on the AP interface itself if the driver can leave the
+	 * channel while beaconing, plain if the AP is not beaconing yet */
+	if (mode == IWINFO_OPMODE_MASTER && iwinfo_ifup(ifname))
 	{
-		/* Got a temp interface, don't create yet another one */
-		if (!strncmp(ifname, "tmp.", 4))
+		if (nl80211_get_wiphy_features(ifname) & NL80211_FEATURE_AP_SCAN)
+			flags = NL80211_SCAN_FLAG_AP;
+
+		if (!(rv = nl80211_get_scanlist_nl(ifname, opts, flags, buf, len)))
 		{
-			if (!iwinfo_ifup(ifname))
-				return -1;
+			*method = flags ? IWINFO_SCAN_METHOD_AP : IWINFO_SCAN_METHOD_DIRECT;
+			return 0;
+		}
 
-			rv = nl80211_get_scanlist_nl(ifname, buf, len);
-			iwinfo_ifdown(ifname);
+		/* only a request the driver refused justifies disturbing the
+		 * AP below; a busy, aborted or timed out scan is reported */
+		if (rv != -EOPNOTSUPP && rv != -EINVAL)
 			return rv;
-		}
+	}
 
-		/* Spawn a new scan interface */
-		else
+	/* Last resort, scan on a temporary interface */
+
+	/* Got a temp interface, don't create yet another one */
+	if (!strncmp(ifname, "tmp.", 4))
+	{
+		if (!iwinfo_ifup(ifname))
+			return -1;
+
+		rv = nl80211_get_scanlist_nl(ifname, opts, 0, buf, len);
+		iwinfo_ifdown(ifname);
+		*method = IWINFO_SCAN_METHOD_TMP_IFACE;
+		return rv;
+	}
+
+	/* Spawn a new scan interface */
+	if (!(res = nl80211_ifadd(ifname)))
+		return -1;
+
+	iwinfo_ifmac(res);
+
+	/* if we can take the new interface up, the driver supports an
+	 * additional interface and there's no need to tear down the ap */
+	if (iwinfo_ifup(res))
+	{
+		rv = nl80211_get_scanlist_nl(res, opts, 0, buf, len);
+		iwinfo_ifdown(res);
+		*method = IWINFO_SCAN_METHOD_TMP_IFACE;
+	}
+
+	/* driver cannot create secondary interface, take down ap
+	 * during scan */
+	else if (iwinfo_ifdown(ifname) && iwinfo_ifup(res))
+	{
+		rv = nl80211_get_scanlist_nl(res, opts, 0, buf, len);
+		iwinfo_ifdown(res);
+		iwinfo_ifup(ifname);
+		nl80211_hostapd_hup(ifname);
+		*method = IWINFO_SCAN_METHOD_AP_DOWN;
+	}
+	else
+		rv = -1;
+
+	nl80211_ifdel(res);
+	return rv;
+}
+
+static int nl80211_scan(const char *ifname, const struct iwinfo_scan_opts *opts,
+                        char *buf, int *len)
+{
+	int rv, method = IWINFO_SCAN_METHOD_UNKNOWN;
+
+	rv = nl80211_scan_iface(ifname, opts, buf, len, &method);
+
+	memset(&nl80211_last_scan, 0, sizeof(nl80211_last_scan));
+	strncpy(nl80211_last_scan.ifname, ifname,
+	        sizeof(nl80211_last_scan.ifname) - 1);
+	nl80211_last_scan.method = rv ? IWINFO_SCAN_METHOD_UNKNOWN : method;
+
+	return rv;
+}
+
+/* how the most recent scan on ifname got its results */
+static int nl80211_get_scan_method(const char *ifname, int *buf)
+{
+	if (!nl80211_last_scan.method ||
+	    strcmp(nl80211_last_scan.ifname, ifname))
+		return -1;
+
+	*buf = nl80211_last_scan.method;
+	return 0;
+}
+
+static int nl80211_get_scanlist(const char *ifname, char *buf, int *len)
+{
+	return nl80211_scan(ifname, NULL, buf, len);
+}
+
+/*
+ * Dump the kernel BSS cache without going off-channel. The cache is kept
+ * per wiphy, so for radioX any interface on it will do.
+ */
+static int nl80211_get_scan_results(const char *ifname, uint32_t max_age,
+                                    char *buf, int *len)
+{
+	char *res;
+	struct nl80211_scanlist sl = {
+		.e = (struct iwinfo_scanlist_entry *)buf,
+		.max_age = max_age
+	};
+
+	*len = 0;
+
+	res = nl80211_phy2ifname(ifname);
+
+	if (nl80211_request(res ? res : ifname, NL80211_CMD_GET_SCAN, NLM_F_DUMP,
+	                    nl80211_get_scanlist_cb, &sl))
+		return -1;
+
+	*len = nl80211_scanlist_size(&sl);
+	return 0;
+}
+
+static void nl80211_scan_free(struct iwinfo_scan *scan)
+{
+	if (scan->cb)
+		nl_cb_put(scan->cb);
+
+	if (scan->sock)
+		nl_socket_free(scan->sock);
+
+	free(scan);
+}
+
+static int nl80211_scan_event_cb(struct nl_msg *msg, void *arg)
+{
+	struct iwinfo_scan *scan = arg;
+	struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
+	struct nlattr **tb = nl80211_parse(msg);
+
+	/* the scan group carries events of every interface */
+	if (!tb[NL80211_ATTR_IFINDEX] ||
+	    nla_get_u32(tb[NL80211_ATTR_IFINDEX]) != scan->ifidx)
+		return NL_SKIP;
+
+	if (scan->sched)
+	{
+		if (gnlh->cmd == NL80211_CMD_SCHED_SCAN_RESULTS)
+			scan->state = 1;
+		else if (gnlh->cmd == NL80211_CMD_SCHED_SCAN_STOPPED)
+			scan->state = -1;
+	}
+	else
+	{
+		if (gnlh->cmd == NL80211_CMD_NEW_SCAN_RESULTS)
+			scan->state = 1;
+		else if (gnlh->cmd == NL80211_CMD_SCAN_ABORTED)
+			scan->state = -1;
+	}
+
+	return NL_SKIP;
+}
+
+/* a socket of its own per handle, listening for the scan events of ifname */
+static struct iwinfo_scan * nl80211_scan_handle(const char *ifname,
+                                                const struct iwinfo_scan_opts *opts)
+{
+	struct iwinfo_scan *scan;
+	char *res;
+	int id, fd;
+
+	if (nl80211_init() < 0)
+		return NULL;
+
+	if ((res = nl80211_phy2ifname(ifname)) != NULL)
+		ifname = res;
+
+	scan = calloc(1, sizeof(*scan));
+
+	if (!scan)
+		return NULL;
+
+	strncpy(scan->ifname, ifname, sizeof(scan->ifname) - 1);
+	scan->ifidx = if_nametoindex(ifname);
+
+	if (opts)
+	{
+		scan->opts = *opts;
+		scan->has_opts = 1;
+	}
+
+	if (!scan->ifidx || (id = nl80211_mcast_id("nl80211", "scan")) < 0)
+		goto err;
+
+	scan->sock = nl_socket_alloc();
+	scan->cb = nl_cb_alloc(NL_CB_DEFAULT);
+
+	if (!scan->sock || !scan->cb ||
+	    genl_connect(scan->sock) ||
+	    nl_socket_set_nonblocking(scan->sock) ||
+	    nl_socket_add_membership(scan->sock, id))
+		goto err;
+
+	fd = nl_socket_get_fd(scan->sock);
+	fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+
+	nl_cb_set(scan->cb, NL_CB_SEQ_CHECK, NL_CB_CUSTOM,
+	          nl80211_wait_seq_check, NULL);
+	nl_cb_set(scan->cb, NL_CB_VALID, NL_CB_CUSTOM,
+	          nl80211_scan_event_cb, scan);
+
+	return scan;
+
+err:
+	nl80211_scan_free(scan);
+	return NULL;
+}
+
+/*
+ * Start a scan without waiting for it. Each handle listens on a socket of
+ * its own, so several radios can scan at once and the caller can poll the
+ * fds alongside anything else. Unlike nl80211_scan() no temporary
+ * interfaces are created, the interface must be able to scan as it is.
+ */
+static int nl80211_scan_start(const char *ifname,
+                              const struct iwinfo_scan_opts *opts,
+                              struct iwinfo_scan **handle)
+{
+	struct iwinfo_scan *scan;
+	uint32_t flags = 0;
+	int mode;
+
+	if (!(*handle = scan = nl80211_scan_handle(ifname, opts)))
+		return -1;
+
+	if (!nl80211_get_mode(scan->ifname, &mode) &&
+	    mode == IWINFO_OPMODE_MASTER &&
+	    (nl80211_get_wiphy_features(scan->ifname) & NL80211_FEATURE_AP_SCAN))
+		flags = NL80211_SCAN_FLAG_AP;
+
+	/* subscribed before triggering, so the completion cannot slip by */
+	if (nl80211_trigger_scan(scan->ifname, opts, flags))
+	{
+		nl80211_scan_free(scan);
+		*handle = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int nl80211_put_sched_scan_opts(struct nl_msg *msg,
+                                       const struct iwinfo_sched_scan_opts *opts)
+{
+	struct nlattr *nest, *set;
+	const struct iwinfo_sched_scan_match *m;
+	const struct iwinfo_sched_scan_plan *p;
+	int i;
+
+	if (nl80211_put_scan_opts(msg, &opts->scan, 0))
+		goto nla_put_failure;
+
+	if (opts->delay)
+		NLA_PUT_U32(msg, NL80211_ATTR_SCHED_SCAN_DELAY, opts->delay);
+
+	/* a match set with only a threshold sets the default for all others */
+	if (opts->n_matches || opts->min_rssi)
+	{
+		if (!(nest = nla_nest_start(msg, NL80211_ATTR_SCHED_SCAN_MATCH)))
+			goto nla_put_failure;
+
+		for (i = 0; i < opts->n_matches; i++)
 		{
-			if (!(res = nl80211_ifadd(ifname)))
-				return -1;
+			m = &opts->matches[i];
 
-			iwinfo_ifmac(res);
+			if (!(set = nla_nest_start(msg, i + 1)))
+				goto nla_put_failure;
 
-			/* if we can take the new interface up, the driver supports an
-			 * additional interface and there's no need to tear down the ap */
-			if (iwinfo_ifup(res))
-			{
-				rv = nl80211_get_scanlist_nl(res, buf, len);
-				iwinfo_ifdown(res);
-			}
+			if (m->ssid[0])
+				NLA_PUT(msg, NL80211_SCHED_SCAN_MATCH_ATTR_SSID,
+				        strlen(m->ssid), m->ssid);
 
-			/* driver cannot create secondary interface, take down ap
-			 * during scan */
-			else if (iwinfo_ifdown(ifname) && iwinfo_ifup(res))
-			{
-				rv = nl80211_get_scanlist_nl(res, buf, len);
-				iwinfo_ifdown(res);
-				iwinfo_ifup(ifname);
-				nl80211_hostapd_hup(ifname);
-			}
-			else
-				rv = -1;
+			if (m->rssi)
+				NLA_PUT_U32(msg, NL80211_SCHED_SCAN_MATCH_ATTR_RSSI,
+				            (uint32_t)(int32_t)m->rssi);
 
-			nl80211_ifdel(res);
-			return rv;
+			nla_nest_end(msg, set);
 		}
+
+		if (opts->min_rssi)
+		{
+			if (!(set = nla_nest_start(msg, i + 1)))
+				goto nla_put_failure;
+
+			NLA_PUT_U32(msg, NL80211_SCHED_SCAN_MATCH_ATTR_RSSI,
+			            (uint32_t)(int32_t)opts->min_rssi);
+
+			nla_nest_end(msg, set);
+		}
+
+		nla_nest_end(msg, nest);
+	}
+
+	if (!opts->n_plans)
+	{
+		NLA_PUT_U32(msg, NL80211_ATTR_SCHED_SCAN_INTERVAL,
+		            NL80211_SCHED_SCAN_INTERVAL * 1000);
+
+		return 0;
 	}
 
+	if (!(nest = nla_nest_start(msg, NL80211_ATTR_SCHED_SCAN_PLANS)))
+		goto nla_put_failure;
+
+	for (i = 0; i < opts->n_plans; i++)
+	{
+		p = &opts->plans[i];
+
+		if (!(set = nla_nest_start(msg, i + 1)))
+			goto nla_put_failure;
+
+		NLA_PUT_U32(msg, NL80211_SCHED_SCAN_PLAN_INTERVAL, p->interval);
+
+		/* the last plan must not have an iteration count */
+		if (i + 1 < opts->n_plans)
+			NLA_PUT_U32(msg, NL80211_SCHED_SCAN_PLAN_ITERATIONS,
+			            p->iterations ? p->iterations : 1);
+
+		nla_nest_end(msg, set);
+	}
+
+	nla_nest_end(msg, nest);
+
+	return 0;
+
+nla_put_failure:
 	return -1;
 }
 
+/*
+ * Hand a recurring scan to the driver, which often offloads it to the
+ * firmware and only reports back when a match set hits. The scan keeps
+ * running without a handle; with one, its fd turns readable on every
+ * round of results.
+ */
+static int nl80211_sched_scan_start(const char *ifname,
+                                    const struct iwinfo_sched_scan_opts *opts,
+                                    struct iwinfo_scan **handle)
+{
+	struct nl80211_msg_conveyor *req;
+	struct iwinfo_scan *scan = NULL;
+	char *res;
+
+	if (handle)
+	{
+		if (!(*handle = scan = nl80211_scan_handle(ifname, &opts->scan)))
+			return -1;
+
+		scan->sched = 1;
+		ifname = scan->ifname;
+	}
+	else if ((res = nl80211_phy2ifname(ifname)) != NULL)
+	{
+		ifname = res;
+	}
+
+	req = nl80211_msg(ifname, NL80211_CMD_START_SCHED_SCAN, 0);
+
+	if (req && nl80211_put_sched_scan_opts(req->msg, opts))
+	{
+		nl80211_free(req);
+		req = NULL;
+	}
+
+	if (!req || nl80211_send(req, NULL, NULL))
+	{
+		if (scan)
+		{
+			nl80211_scan_free(scan);
+			*handle = NULL;
+		}
+
+		return -1;
+	}
+
+	return 0;
+}
+
+static int nl80211_sched_scan_stop(const char *ifname)
+{
+	char *res = nl80211_phy2ifname(ifname);
+
+	return nl80211_request(res ? res : ifname, NL80211_CMD_STOP_SCHED_SCAN, 0,
+	                       NULL, NULL) ? -1 : 0;
+}
+
+static int nl80211_scan_fd(const struct iwinfo_scan *scan)
+{
+	return scan ? nl_socket_get_fd(scan->sock) : -1;
+}
+
+static int nl80211_scan_collect(struct iwinfo_scan *scan, char *buf, int *len)
+{
+	struct nl80211_scanlist sl = { .e = (struct iwinfo_scanlist_entry *)buf };
+
+	*len = 0;
+
+	/* non-blocking, stops with -NLE_AGAIN once the queue is empty */
+	while (!scan->state && nl_recvmsgs(scan->sock, scan->cb) >= 0)
+		;
+
+	if (!scan->state)
+		return -EAGAIN;
+
+	if (scan->state < 0)
+		return -1;
+
+	sl.opts = scan->has_opts ? &scan->opts : NULL;
+	sl.filter = nl80211_scan_filter(sl.opts);
+
+	if (nl80211_request(scan->ifname, NL80211_CMD_GET_SCAN, NLM_F_DUMP,
+	                    nl80211_get_scanlist_cb, &sl))
+		return -1;
+
+	/* wait for the next round */
+	if (scan->sched)
+		scan->state = 0;
+
+	*len = nl80211_scanlist_size(&sl);
+	return 0;
+}
+
+/* releases the handle, stopping the scan if it is still running */
+static void nl80211_scan_abort(struct iwinfo_scan *scan)
+{
+	if (!scan)
+		return;
+
+	if (scan->sched && scan->state >= 0)
+		nl80211_sched_scan_stop(scan->ifname);
+	else if (!scan->state)
+		nl80211_request(scan->ifname, NL80211_CMD_ABORT_SCAN, 0, NULL, NULL);
+
+	nl80211_scan_free(scan);
+}
+
 static int nl80211_get_freqlist_cb(struct nl_msg *msg, void *arg)
 {
 	int bands_remain, freqs_remain;
@@ -3678,9 +5265,20 @@ const struct iwinfo_ops nl80211_ops = {
 	.assoclist        = nl80211_get_assoclist,
 	.txpwrlist        = nl80211_get_txpwrlist,
 	.scanlist         = nl80211_get_scanlist,
+	.scan             = nl80211_scan,
+	.scan_results     = nl80211_get_scan_results,
+	.scan_start       = nl80211_scan_start,
+	.scan_fd          = nl80211_scan_fd,
+	.scan_collect     = nl80211_scan_collect,
+	.scan_abort       = nl80211_scan_abort,
+	.scan_method      = nl80211_get_scan_method,
+	.sched_scan_start = nl80211_sched_scan_start,
+	.sched_scan_stop  = nl80211_sched_scan_stop,
 	.freqlist         = nl80211_get_freqlist,
 	.countrylist      = nl80211_get_countrylist,
 	.survey           = nl80211_get_survey,
+	.survey_mode      = nl80211_get_survey_mode,
+	.txq_stats        = nl80211_get_txq_stats,
 	.lookup_phy       = nl80211_lookup_phyname,
 	.phy_path         = nl80211_phy_path,
 	.close            = nl80211_close
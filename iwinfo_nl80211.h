@@ -25,6 +25,7 @@
 #include <string.h>
 #include <dirent.h>
 #include <signal.h>
+#include <poll.h>
 #include <sys/un.h>
 #include <netlink/netlink.h>
 #include <netlink/genl/genl.h>
@@ -35,11 +36,18 @@
 #include "iwinfo/utils.h"
 #include "api/nl80211.h"
 
+/* number of extra sockets used to run dump requests concurrently */
+#define NL80211_POOL_SIZE	4
+
+/* upper bound of WDS station interfaces considered per interface */
+#define NL80211_MAX_SUBIFS	256
+
 struct nl80211_state {
 	struct nl_sock *nl_sock;
 	struct nl_cache *nl_cache;
 	struct genl_family *nl80211;
 	struct genl_family *nlctrl;
+	struct nl_sock *nl_pool[NL80211_POOL_SIZE];
 };
 
 struct nl80211_msg_conveyor {
@@ -47,6 +55,12 @@ struct nl80211_msg_conveyor {
 	struct nl_cb *cb;
 };
 
+struct nl80211_pool_slot {
+	struct nl80211_msg_conveyor cv;
+	int busy;
+	int err;
+};
+
 struct nl80211_event_conveyor {
 	uint32_t wait[(NL80211_CMD_MAX / 32) + !!(NL80211_CMD_MAX % 32)];
 	int recv;
@@ -64,9 +78,62 @@ struct nl80211_rssi_rate {
 	int rssi_samples;
 };
 
+/* number of radios whose last noise sample is remembered */
+#define NL80211_NOISE_CACHE_SIZE	8
+
+struct nl80211_noise_cache {
+	int phyidx;
+	int8_t noise;
+	uint64_t stamp;
+};
+
 struct nl80211_array_buf {
 	void *buf;
 	int count;
 };
 
+struct nl80211_txq_buf {
+	int found;
+	struct iwinfo_txq_stats stats;
+};
+
+struct nl80211_scan_method {
+	char ifname[IFNAMSIZ];
+	int method;
+};
+
+/* scan deadline budget per channel and on top, in ms */
+#define NL80211_SCAN_ACTIVE_TIME	60
+#define NL80211_SCAN_PASSIVE_TIME	130
+#define NL80211_SCAN_SLACK		2000
+#define NL80211_SCAN_MAX_CHANNELS	72
+/* AP and low priority scans return to the operating channel in between */
+#define NL80211_SCAN_HOME_TIME		200
+/* wait for the event of an aborted scan, so the next wait doesn't see it */
+#define NL80211_SCAN_ABORT_TIME		1000
+
+/* reply timeout of wpa_supplicant control commands */
+#define NL80211_WPACTL_TIMEOUT		256
+
+/* used for scheduled scans started without any plan */
+#define NL80211_SCHED_SCAN_INTERVAL	60
+
+/* state: 0 while running, 1 when results are ready, -1 if aborted;
+ * a scheduled scan goes back to 0 after each collect */
+struct iwinfo_scan {
+	struct nl_sock *sock;
+	struct nl_cb *cb;
+	char ifname[IFNAMSIZ];
+	uint32_t ifidx;
+	int state;
+	int sched;
+	int has_opts;
+	struct iwinfo_scan_opts opts;
+};
+
+struct nl80211_sta_dump {
+	struct nl80211_array_buf *arr;
+	const char *ifname;
+};
+
 #endif
@@ -0,0 +1,185 @@
+/*
+ * iwinfo - Wireless Information Library - Survey sampler
+ *
+ * The iwinfo library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * The iwinfo library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with the iwinfo library. If not, see http://www.gnu.org/licenses/.
+ */
+
+#include "iwinfo/utils.h"
+
+
+/* survey dumps come in the same order every time, try hint first */
+static int iwinfo_survey_find(const struct iwinfo_survey_sampler *s,
+                              uint32_t mhz, int hint)
+{
+	int i;
+
+	if (hint < s->count && s->chan[hint].mhz == mhz)
+		return hint;
+
+	for (i = 0; i < s->count; i++)
+		if (s->chan[i].mhz == mhz)
+			return i;
+
+	return -1;
+}
+
+static int iwinfo_survey_add(struct iwinfo_survey_sampler *s,
+                             const struct iwinfo_survey_entry *e)
+{
+	struct iwinfo_survey_channel *chan;
+	int size;
+
+	if (s->count == s->size)
+	{
+		size = s->size ? s->size * 2 : 16;
+
+		if (!(chan = realloc(s->chan, size * sizeof(*chan))))
+			return -1;
+
+		s->chan = chan;
+		s->size = size;
+	}
+
+	chan = &s->chan[s->count];
+	memset(chan, 0, sizeof(*chan));
+
+	chan->mhz = e->mhz;
+	chan->last = *e;
+
+	return s->count++;
+}
+
+static uint16_t iwinfo_survey_permille(uint64_t part, uint64_t total)
+{
+	return (part >= total) ? 1000 : (uint16_t)(part * 1000 / total);
+}
+
+/* returns 1 if a sample was stored */
+static int iwinfo_survey_sample(struct iwinfo_survey_channel *c,
+                                const struct iwinfo_survey_entry *e,
+                                uint64_t stamp)
+{
+	struct iwinfo_survey_sample *smp = &c->history[c->hist_pos];
+	uint64_t active = e->active_time - c->last.active_time;
+	uint64_t busy = e->busy_time - c->last.busy_time;
+	uint64_t rx = e->rxtime - c->last.rxtime;
+	uint64_t tx = e->txtime - c->last.txtime;
+
+	/* counters only decrease when the driver reset them */
+	if (e->busy_time < c->last.busy_time ||
+	    e->busy_time_ext < c->last.busy_time_ext ||
+	    e->rxtime < c->last.rxtime || e->txtime < c->last.txtime)
+		return 0;
+
+	smp->stamp = stamp;
+	smp->active = active;
+	smp->busy = iwinfo_survey_permille(busy, active);
+	smp->busy_ext = iwinfo_survey_permille(e->busy_time_ext -
+	                                       c->last.busy_time_ext, active);
+	smp->rx = iwinfo_survey_permille(rx, active);
+	smp->tx = iwinfo_survey_permille(tx, active);
+	smp->other = (busy > rx + tx)
+		? iwinfo_survey_permille(busy - rx - tx, active) : 0;
+	smp->noise = (int8_t)e->noise;
+
+	c->hist_pos = (c->hist_pos + 1) % IWINFO_SURVEY_HISTORY;
+
+	if (c->hist_len < IWINFO_SURVEY_HISTORY)
+		c->hist_len++;
+
+	return 1;
+}
+
+int iwinfo_survey_sampler_init(struct iwinfo_survey_sampler *s)
+{
+	memset(s, 0, sizeof(*s));
+
+	return 0;
+}
+
+/*
+ * Feed a survey dump of the radio and return the number of channels that
+ * got a new sample. The first update of a channel only records its
+ * counters.
+ */
+int iwinfo_survey_sampler_update(struct iwinfo_survey_sampler *s,
+                                 const char *buf, int len)
+{
+	const struct iwinfo_survey_entry *e;
+	struct iwinfo_survey_channel *c;
+	uint64_t now = iwinfo_msec();
+	int i, idx, n = 0;
+
+	for (i = 0; i + (int)sizeof(*e) <= len; i += sizeof(*e))
+	{
+		e = (const struct iwinfo_survey_entry *)&buf[i];
+
+		if ((idx = iwinfo_survey_find(s, e->mhz, i / sizeof(*e))) < 0)
+		{
+			if (iwinfo_survey_add(s, e) < 0)
+				return -1;
+
+			continue;
+		}
+
+		c = &s->chan[idx];
+
+		if (e->active_time > c->last.active_time)
+			n += iwinfo_survey_sample(c, e, now);
+
+		c->last = *e;
+	}
+
+	s->stamp = now;
+
+	return n;
+}
+
+const struct iwinfo_survey_channel *
+iwinfo_survey_sampler_lookup(const struct iwinfo_survey_sampler *s,
+                             uint32_t mhz)
+{
+	int i = iwinfo_survey_find(s, mhz, 0);
+
+	return (i >= 0) ? &s->chan[i] : NULL;
+}
+
+const struct iwinfo_survey_sample *
+iwinfo_survey_latest(const struct iwinfo_survey_channel *c)
+{
+	if (!c->hist_len)
+		return NULL;
+
+	return &c->history[(c->hist_pos + IWINFO_SURVEY_HISTORY - 1) %
+	                   IWINFO_SURVEY_HISTORY];
+}
+
+/* samples oldest first */
+int iwinfo_survey_history(const struct iwinfo_survey_channel *c,
+                          struct iwinfo_survey_sample *buf)
+{
+	int i, start = (c->hist_pos + IWINFO_SURVEY_HISTORY - c->hist_len) %
+	               IWINFO_SURVEY_HISTORY;
+
+	for (i = 0; i < c->hist_len; i++)
+		buf[i] = c->history[(start + i) % IWINFO_SURVEY_HISTORY];
+
+	return c->hist_len;
+}
+
+void iwinfo_survey_sampler_free(struct iwinfo_survey_sampler *s)
+{
+	free(s->chan);
+
+	memset(s, 0, sizeof(*s));
+}
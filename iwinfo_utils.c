@@ -20,6 +20,9 @@
  * inspired by the hostapd madwifi driver.
  */
 
+#include <time.h>
+#include <poll.h>
+
 #include "iwinfo/utils.h"
 
 
@@ -43,6 +46,38 @@ int iwinfo_ioctl(int cmd, void *ifr)
 	return ioctl(s, cmd, ifr);
 }
 
+uint64_t iwinfo_msec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Wait until fd is readable or the iwinfo_msec() deadline passed.
+ * Returns 1 if readable, 0 on timeout and -1 on error.
+ */
+int iwinfo_wait_fd(int fd, uint64_t deadline)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	uint64_t now;
+	int ret;
+
+	while ((now = iwinfo_msec()) < deadline)
+	{
+		ret = poll(&pfd, 1, (int)(deadline - now));
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+
+		return (ret > 0) ? 1 : ret;
+	}
+
+	return 0;
+}
+
 int iwinfo_dbm2mw(int in)
 {
 	double res = 1.0;
@@ -448,6 +483,255 @@ int iwinfo_hardware_id_from_mtd(struct iwinfo_hardware_id *id)
 	return (id->vendor_id && id->device_id) ? 0 : -1;
 }
 
+static uint16_t iwinfo_permille(uint64_t part, uint64_t whole)
+{
+	if (!whole)
+		return 0;
+
+	return (part >= whole) ? 1000 : part * 1000 / whole;
+}
+
+/* backlog is a gauge, everything else counts up */
+void iwinfo_txq_delta(const struct iwinfo_txq_stats *prev,
+                      const struct iwinfo_txq_stats *cur,
+                      struct iwinfo_txq_stats *d)
+{
+	d->backlog_bytes   = cur->backlog_bytes;
+	d->backlog_packets = cur->backlog_packets;
+	d->flows           = cur->flows - prev->flows;
+	d->drops           = cur->drops - prev->drops;
+	d->ecn_marks       = cur->ecn_marks - prev->ecn_marks;
+	d->overlimit       = cur->overlimit - prev->overlimit;
+	d->overmemory      = cur->overmemory - prev->overmemory;
+	d->collisions      = cur->collisions - prev->collisions;
+	d->tx_bytes        = cur->tx_bytes - prev->tx_bytes;
+	d->tx_packets      = cur->tx_packets - prev->tx_packets;
+}
+
+/*
+ * Turn two assoclist snapshots taken interval ms apart into per-station
+ * counter deltas. Stations are matched by MAC, stations which are only in
+ * one of the snapshots are skipped. Counters are subtracted unsigned so
+ * that 32 bit wraps come out right; a station that reconnected in between
+ * starts again from zero.
+ */
+int iwinfo_assoclist_delta(const char *prev, int prev_len,
+                           const char *cur, int cur_len,
+                           uint32_t interval, char *buf, int *len)
+{
+	struct iwinfo_macindex idx;
+	const struct iwinfo_assoclist_entry *p, *c;
+	struct iwinfo_assoclist_delta *d = (struct iwinfo_assoclist_delta *)buf;
+	struct iwinfo_assoclist_entry zero = { 0 };
+	uint64_t airtime, total = 0;
+	int i, ac, count = 0;
+
+	*len = 0;
+
+	if (!interval ||
+	    iwinfo_macindex_build(&idx, prev, prev_len, sizeof(*p)))
+		return -1;
+
+	for (i = 0; i + (int)sizeof(*c) <= cur_len; i += sizeof(*c))
+	{
+		c = (const struct iwinfo_assoclist_entry *)&cur[i];
+
+		if (!(p = iwinfo_macindex_lookup(&idx, c->mac)))
+			continue;
+
+		if ((count + 1) * sizeof(*d) > IWINFO_BUFSIZE)
+			break;
+
+		if (c->connected_time < p->connected_time)
+			p = &zero;
+
+		memset(d, 0, sizeof(*d));
+		memcpy(d->mac, c->mac, 6);
+
+		d->interval    = interval;
+		d->rx_bytes    = c->rx_bytes - p->rx_bytes;
+		d->tx_bytes    = c->tx_bytes - p->tx_bytes;
+		d->rx_packets  = c->rx_packets - p->rx_packets;
+		d->tx_packets  = c->tx_packets - p->tx_packets;
+		d->tx_retries  = c->tx_retries - p->tx_retries;
+		d->tx_failed   = c->tx_failed - p->tx_failed;
+		d->rx_duration = c->rx_duration - p->rx_duration;
+		d->tx_duration = c->tx_duration - p->tx_duration;
+
+		d->airtime_weight = c->airtime_weight;
+
+		d->rx_mpdus    = c->rx_mpdus - p->rx_mpdus;
+		d->fcs_errors  = c->fcs_errors - p->fcs_errors;
+		d->beacon_loss = c->beacon_loss - p->beacon_loss;
+		d->beacon_rx   = c->beacon_rx - p->beacon_rx;
+
+		/* rx_mpdus includes the ones that failed the FCS check, retries
+		 * count extra attempts on top of the delivered packets */
+		d->rx_per = iwinfo_permille(d->fcs_errors, d->rx_mpdus);
+		d->tx_per = iwinfo_permille(d->tx_retries,
+		                            (uint64_t)d->tx_packets + d->tx_retries);
+
+		d->beacon_loss_rate = (uint64_t)d->beacon_loss * 3600000 / interval;
+
+		for (ac = 0; ac < IWINFO_AC_COUNT; ac++)
+		{
+			d->ac[ac].rx_msdu = c->ac[ac].rx_msdu - p->ac[ac].rx_msdu;
+			d->ac[ac].tx_msdu = c->ac[ac].tx_msdu - p->ac[ac].tx_msdu;
+			d->ac[ac].tx_msdu_retries =
+				c->ac[ac].tx_msdu_retries - p->ac[ac].tx_msdu_retries;
+			d->ac[ac].tx_msdu_failed =
+				c->ac[ac].tx_msdu_failed - p->ac[ac].tx_msdu_failed;
+
+			iwinfo_txq_delta(&p->ac[ac].txq, &c->ac[ac].txq, &d->ac[ac].txq);
+		}
+
+		/* durations are in us, the interval in ms */
+		airtime = d->rx_duration + d->tx_duration;
+		d->airtime = (airtime / interval > 1000) ? 1000 : airtime / interval;
+		total += airtime;
+
+		d++;
+		count++;
+	}
+
+	iwinfo_macindex_free(&idx);
+
+	for (i = 0, d = (struct iwinfo_assoclist_delta *)buf; i < count; i++, d++)
+		if (total)
+			d->airtime_share = (uint16_t)
+				((d->rx_duration + d->tx_duration) * 1000 / total);
+
+	*len = count * sizeof(*d);
+	return 0;
+}
+
+/*
+ * Sum up an assoclist delta into interface wide error rates and point
+ * at the worst station in either direction.
+ */
+int iwinfo_link_summary(const char *buf, int len,
+                        struct iwinfo_link_summary *st)
+{
+	const struct iwinfo_assoclist_delta *d;
+	uint64_t mpdus = 0, fcs = 0, pkts = 0, retries = 0;
+	int i;
+
+	memset(st, 0, sizeof(*st));
+
+	for (i = 0; i + (int)sizeof(*d) <= len; i += sizeof(*d))
+	{
+		d = (const struct iwinfo_assoclist_delta *)&buf[i];
+
+		mpdus   += d->rx_mpdus;
+		fcs     += d->fcs_errors;
+		pkts    += d->tx_packets;
+		retries += d->tx_retries;
+
+		st->beacon_loss += d->beacon_loss;
+		st->stations++;
+
+		if (d->rx_per > st->worst_rx_per)
+		{
+			st->worst_rx_per = d->rx_per;
+			memcpy(st->worst_rx_mac, d->mac, 6);
+		}
+
+		if (d->tx_per > st->worst_tx_per)
+		{
+			st->worst_tx_per = d->tx_per;
+			memcpy(st->worst_tx_mac, d->mac, 6);
+		}
+	}
+
+	if (!st->stations)
+		return -1;
+
+	st->rx_per = iwinfo_permille(fcs, mpdus);
+	st->tx_per = iwinfo_permille(retries, pkts + retries);
+
+	return 0;
+}
+
+int iwinfo_chain_imbalance(const char *buf, int len,
+                           struct iwinfo_chain_stats *st)
+{
+	const struct iwinfo_assoclist_entry *e;
+	const int8_t *sig;
+	double mean, off, lo, hi, sum[IWINFO_MAX_CHAINS] = { 0 };
+	int cnt[IWINFO_MAX_CHAINS] = { 0 };
+	int i, c, n;
+	uint8_t mask;
+
+	memset(st, 0, sizeof(*st));
+
+	for (i = 0; i + (int)sizeof(*e) <= len; i += sizeof(*e))
+	{
+		e = (const struct iwinfo_assoclist_entry *)&buf[i];
+
+		/* prefer the averaged values, the last PPDU ones are noisy */
+		if (e->chains_avg & (e->chains_avg - 1))
+		{
+			sig = e->chain_signal_avg;
+			mask = e->chains_avg;
+		}
+		else
+		{
+			sig = e->chain_signal;
+			mask = e->chains;
+		}
+
+		for (c = 0, n = 0, mean = 0.0; c < IWINFO_MAX_CHAINS; c++)
+		{
+			if (mask & (1 << c))
+			{
+				mean += sig[c];
+				n++;
+			}
+		}
+
+		if (n < 2)
+			continue;
+
+		mean /= n;
+
+		/* accumulate the deviation of each chain from the station mean,
+		 * this cancels out the distance of the individual stations */
+		for (c = 0; c < IWINFO_MAX_CHAINS; c++)
+		{
+			if (mask & (1 << c))
+			{
+				sum[c] += sig[c] - mean;
+				cnt[c]++;
+			}
+		}
+
+		st->chains |= mask;
+		st->stations++;
+	}
+
+	if (!st->stations)
+		return -1;
+
+	for (c = 0, lo = 127.0, hi = -128.0; c < IWINFO_MAX_CHAINS; c++)
+	{
+		if (!cnt[c])
+			continue;
+
+		off = sum[c] / cnt[c];
+		st->offset[c] = (int8_t)(off + ((off < 0) ? -0.5 : 0.5));
+
+		if (off < lo)
+			lo = off;
+
+		if (off > hi)
+			hi = off;
+	}
+
+	st->imbalance = (uint8_t)(hi - lo + 0.5);
+
+	return 0;
+}
+
 static void iwinfo_parse_rsn_cipher(uint8_t idx, uint16_t *ciphers)
 {
 	switch (idx)
@@ -496,7 +780,7 @@ static void iwinfo_parse_rsn_cipher(uint8_t idx, uint16_t *ciphers)
 	}
 }
 
-void iwinfo_parse_rsn(struct iwinfo_crypto_entry *c, uint8_t *data, uint8_t len,
+void iwinfo_parse_rsn(struct iwinfo_crypto_entry *c, const uint8_t *data, uint8_t len,
 					  uint16_t defcipher, uint8_t defauth)
 {
 	uint16_t i, count;
@@ -505,14 +789,12 @@ void iwinfo_parse_rsn(struct iwinfo_crypto_entry *c, uint8_t *data, uint8_t len,
 	static unsigned char ms_oui[3]        = { 0x00, 0x50, 0xf2 };
 	static unsigned char ieee80211_oui[3] = { 0x00, 0x0f, 0xac };
 
+	if (len < 2)
+		return;
+
 	data += 2;
 	len -= 2;
 
-	if (!memcmp(data, ms_oui, 3))
-		wpa_version |= 1;
-	else if (!memcmp(data, ieee80211_oui, 3))
-		wpa_version |= 2;
-
 	if (len < 4)
 	{
 		c->group_ciphers |= defcipher;
@@ -521,6 +803,11 @@ void iwinfo_parse_rsn(struct iwinfo_crypto_entry *c, uint8_t *data, uint8_t len,
 		return;
 	}
 
+	if (!memcmp(data, ms_oui, 3))
+		wpa_version |= 1;
+	else if (!memcmp(data, ieee80211_oui, 3))
+		wpa_version |= 2;
+
 	if (!memcmp(data, ms_oui, 3) || !memcmp(data, ieee80211_oui, 3))
 		iwinfo_parse_rsn_cipher(data[3], &c->group_ciphers);
 
@@ -613,3 +900,750 @@ void iwinfo_parse_rsn(struct iwinfo_crypto_entry *c, uint8_t *data, uint8_t len,
 	data += 2 + (count * 4);
 	len -= 2 + (count * 4);
 }
+
+/*
+ * Information element walker. Every element ID is dispatched through a
+ * table entry naming its minimum length and parser; most elements are
+ * just recorded in the view slot given by kind. Elements shorter than
+ * the table minimum are skipped, so parsers may read that much without
+ * further checks.
+ */
+struct iwinfo_ie_desc {
+	uint8_t min_len;
+	uint8_t kind;
+	void (*parse)(struct iwinfo_ie_view *v, const struct iwinfo_ie_desc *d,
+	              const uint8_t *data, uint8_t len);
+};
+
+/* the first occurrence wins */
+static inline void __iwinfo_ie_store(struct iwinfo_ie_view *v, uint8_t kind,
+                                     const uint8_t *data, uint8_t len)
+{
+	if (v->present & (1 << kind))
+		return;
+
+	v->present |= (1 << kind);
+	v->ie[kind].data = data;
+	v->ie[kind].len = len;
+}
+
+static void iwinfo_ie_store(struct iwinfo_ie_view *v,
+                            const struct iwinfo_ie_desc *d,
+                            const uint8_t *data, uint8_t len)
+{
+	__iwinfo_ie_store(v, d->kind, data, len);
+}
+
+static void iwinfo_ie_mbssid_store(struct iwinfo_ie_view *v,
+                                   const struct iwinfo_ie_desc *d,
+                                   const uint8_t *data, uint8_t len)
+{
+	__iwinfo_ie_store(v, d->kind, data, len);
+	v->n_mbssid++;
+}
+
+static void iwinfo_ie_rnr_store(struct iwinfo_ie_view *v,
+                                const struct iwinfo_ie_desc *d,
+                                const uint8_t *data, uint8_t len)
+{
+	__iwinfo_ie_store(v, d->kind, data, len);
+	v->n_rnr++;
+}
+
+static void iwinfo_ie_vendor(struct iwinfo_ie_view *v,
+                             const struct iwinfo_ie_desc *d,
+                             const uint8_t *data, uint8_t len)
+{
+	/* Microsoft WPA element, the body is handed on from the version */
+	if (len >= 6 && data[0] == 0x00 && data[1] == 0x50 && data[2] == 0xf2 &&
+	    data[3] == 1)
+		__iwinfo_ie_store(v, IWINFO_IE_WPA, data + 4, len - 4);
+}
+
+#define IWINFO_IE(kind, min) \
+	{ min, IWINFO_IE_##kind, iwinfo_ie_store }
+
+static const struct iwinfo_ie_desc iwinfo_ie_ext_ids[] = {
+	[36]  = IWINFO_IE(HE_OP, 6),		/* HE Operation */
+	[56]  = IWINFO_IE(NON_INHERIT, 2),	/* Non-Inheritance */
+	[106] = IWINFO_IE(EHT_OP, 5),		/* EHT Operation */
+};
+
+static void iwinfo_ie_ext(struct iwinfo_ie_view *v,
+                          const struct iwinfo_ie_desc *d,
+                          const uint8_t *data, uint8_t len)
+{
+	if (data[0] >= ARRAY_SIZE(iwinfo_ie_ext_ids))
+		return;
+
+	d = &iwinfo_ie_ext_ids[data[0]];
+
+	if (d->parse && len - 1 >= d->min_len)
+		d->parse(v, d, data + 1, len - 1);
+}
+
+static const struct iwinfo_ie_desc iwinfo_ie_ids[256] = {
+	[0]   = IWINFO_IE(SSID, 0),		/* SSID */
+	[11]  = IWINFO_IE(BSS_LOAD, 5),		/* BSS Load */
+	[48]  = IWINFO_IE(RSN, 2),		/* RSN */
+	[61]  = IWINFO_IE(HT_OP, 3),		/* HT Operation */
+	[71]  = { 1, IWINFO_IE_MBSSID, iwinfo_ie_mbssid_store },	/* Multiple BSSID */
+	[83]  = IWINFO_IE(NONTX_CAP, 2),	/* Nontransmitted BSSID Capability */
+	[85]  = IWINFO_IE(MBSSID_INDEX, 1),	/* Multiple BSSID-Index */
+	[114] = IWINFO_IE(MESH_ID, 0),		/* Mesh ID */
+	[127] = IWINFO_IE(EXT_CAP, 1),		/* Extended Capabilities */
+	[192] = IWINFO_IE(VHT_OP, 3),		/* VHT Operation */
+	[201] = { 4, IWINFO_IE_RNR, iwinfo_ie_rnr_store },	/* Reduced Neighbor Report */
+	[221] = { 4, 0, iwinfo_ie_vendor },	/* Vendor Specific */
+	[255] = { 1, 0, iwinfo_ie_ext },	/* Element ID Extension */
+};
+
+/*
+ * Build a view of the elements in ie. The view points into ie, which has
+ * to outlive it. Returns the number of elements or -1 if the last one is
+ * truncated, in which case the view covers everything before it.
+ */
+int iwinfo_ie_parse(const uint8_t *ie, int len, struct iwinfo_ie_view *v)
+{
+	const struct iwinfo_ie_desc *d;
+	int n = 0;
+
+	v->present = 0;
+	v->n_mbssid = 0;
+	v->n_rnr = 0;
+	v->raw = ie;
+	v->raw_len = len;
+
+	while (len >= 2)
+	{
+		if (ie[1] + 2 > len)
+			return -1;
+
+		d = &iwinfo_ie_ids[ie[0]];
+
+		/* most elements are either unknown or plainly recorded */
+		if (!d->parse || ie[1] < d->min_len)
+			;
+		else if (d->parse == iwinfo_ie_store)
+			__iwinfo_ie_store(v, d->kind, ie + 2, ie[1]);
+		else
+			d->parse(v, d, ie + 2, ie[1]);
+
+		len -= ie[1] + 2;
+		ie += ie[1] + 2;
+		n++;
+	}
+
+	return n;
+}
+
+/*
+ * Iterate over all elements with the given ID, for elements which may
+ * occur more than once. Start with it->data = NULL, returns 0 when done.
+ */
+int iwinfo_ie_next(const struct iwinfo_ie_view *v, uint8_t id,
+                   struct iwinfo_ie *it)
+{
+	const uint8_t *ie = it->data ? it->data + it->len : v->raw;
+	const uint8_t *end = v->raw + v->raw_len;
+
+	while (end - ie >= 2 && ie + 2 + ie[1] <= end)
+	{
+		if (ie[0] == id)
+		{
+			it->data = ie + 2;
+			it->len = ie[1];
+			return 1;
+		}
+
+		ie += ie[1] + 2;
+	}
+
+	return 0;
+}
+
+/* 6 GHz classes are 131 to 137, see IEEE 802.11 Annex E table E-4 */
+static uint32_t iwinfo_opclass2freq(uint8_t op_class, uint8_t chan)
+{
+	if (op_class == 136)
+		return 5925 + chan * 5;
+	else if (op_class >= 131 && op_class <= 137)
+		return 5950 + chan * 5;
+	else if (op_class >= 115 && op_class <= 130)
+		return 5000 + chan * 5;
+	else if (op_class == 82)
+		return 2484;
+	else if (op_class >= 81 && op_class <= 84)
+		return 2407 + chan * 5;
+
+	return 0;
+}
+
+/*
+ * Collect the neighbor APs of all Reduced Neighbor Report elements, one
+ * per Neighbor AP Information field. Returns the number of entries.
+ */
+int iwinfo_ie_rnr(const struct iwinfo_ie_view *v,
+                  struct iwinfo_rnr_ap *aps, int max)
+{
+	struct iwinfo_ie it = { 0 };
+	uint16_t hdr;
+	int pos, n = 0;
+
+	if (!v->n_rnr)
+		return 0;
+
+	while (n < max && iwinfo_ie_next(v, 201, &it))
+	{
+		/* TBTT Information Header, Operating Class, Channel Number
+		 * and TBTT Information Count times TBTT Information Length */
+		for (pos = 0; n < max && pos + 4 <= it.len; )
+		{
+			hdr = it.data[pos] | (it.data[pos + 1] << 8);
+
+			aps[n].op_class = it.data[pos + 2];
+			aps[n].channel = it.data[pos + 3];
+			aps[n].mhz = iwinfo_opclass2freq(aps[n].op_class,
+			                                 aps[n].channel);
+
+			pos += 4 + (((hdr >> 4) & 0xf) + 1) * (hdr >> 8);
+
+			if (pos > it.len)
+				break;
+
+			n++;
+		}
+	}
+
+	return n;
+}
+
+/* whether a nontransmitted BSSID profile inherits element id */
+static int iwinfo_ie_inherits(const struct iwinfo_ie_view *pv, uint8_t id)
+{
+	const struct iwinfo_ie *ni = iwinfo_ie_get(pv, IWINFO_IE_NON_INHERIT);
+	int i;
+
+	/* List of Element IDs, the Element ID Extensions follow */
+	if (ni && ni->data[0] < ni->len)
+		for (i = 0; i < ni->data[0]; i++)
+			if (ni->data[1 + i] == id)
+				return 0;
+
+	return 1;
+}
+
+/*
+ * Expand the nontransmitted BSSID profiles of all Multiple BSSID elements
+ * into scan entries. A profile inherits everything but the SSID and the
+ * crypto settings from tx, its BSSID is derived from the one of tx and
+ * the profile index. Profiles split across elements are skipped. Returns
+ * the number of entries written to out.
+ */
+int iwinfo_ie_mbssid(const struct iwinfo_ie_view *v,
+                     const struct iwinfo_scanlist_entry *tx,
+                     struct iwinfo_scanlist_entry *out, int max)
+{
+	struct iwinfo_ie it = { 0 };
+	struct iwinfo_ie_view pv;
+	const struct iwinfo_ie *idx, *cap, *ssid, *rsn;
+	struct iwinfo_scanlist_entry *e;
+	uint64_t mac, mask;
+	int i, pos, sublen, n = 0;
+
+	if (!v->n_mbssid)
+		return 0;
+
+	while (n < max && iwinfo_ie_next(v, 71, &it))
+	{
+		/* MaxBSSID Indicator, the set holds 2^n BSSIDs */
+		if (it.data[0] < 1 || it.data[0] > 8)
+			continue;
+
+		mask = (1ULL << it.data[0]) - 1;
+
+		for (pos = 1; n < max && pos + 2 <= it.len; pos += 2 + sublen)
+		{
+			sublen = it.data[pos + 1];
+
+			if (pos + 2 + sublen > it.len)
+				break;
+
+			/* Nontransmitted BSSID Profile subelement */
+			if (it.data[pos] != 0)
+				continue;
+
+			iwinfo_ie_parse(it.data + pos + 2, sublen, &pv);
+
+			idx = iwinfo_ie_get(&pv, IWINFO_IE_MBSSID_INDEX);
+			cap = iwinfo_ie_get(&pv, IWINFO_IE_NONTX_CAP);
+			ssid = iwinfo_ie_get(&pv, IWINFO_IE_SSID);
+
+			if (!idx || !cap || !ssid || !idx->data[0] ||
+			    idx->data[0] > mask)
+				continue;
+
+			e = &out[n++];
+			*e = *tx;
+
+			for (i = 0, mac = 0; i < 6; i++)
+				mac = (mac << 8) | tx->mac[i];
+
+			mac = (mac & ~mask) | (((mac & mask) + idx->data[0]) & mask);
+
+			for (i = 5; i >= 0; i--, mac >>= 8)
+				e->mac[i] = mac & 0xff;
+
+			e->mbssid_index = idx->data[0];
+			e->mbssid_derived = 1;
+
+			i = (ssid->len < IWINFO_ESSID_MAX_SIZE) ? ssid->len : IWINFO_ESSID_MAX_SIZE;
+			memcpy(e->ssid, ssid->data, i);
+			e->ssid[i] = 0;
+
+			/* Privacy bit of the profile capabilities */
+			memset(&e->crypto, 0, sizeof(e->crypto));
+
+			if (!(cap->data[0] & (1 << 4)))
+				continue;
+
+			e->crypto.enabled = 1;
+
+			if ((rsn = iwinfo_ie_get(&pv, IWINFO_IE_RSN)) != NULL)
+				iwinfo_parse_rsn(&e->crypto, rsn->data, rsn->len,
+				                 IWINFO_CIPHER_CCMP, IWINFO_KMGMT_8021x);
+			else if (iwinfo_ie_inherits(&pv, 48))
+				e->crypto = tx->crypto;
+
+			e->crypto.enabled = 1;
+
+			if (!e->crypto.wpa_version)
+			{
+				e->crypto.auth_algs    = IWINFO_AUTH_OPEN | IWINFO_AUTH_SHARED;
+				e->crypto.pair_ciphers = IWINFO_CIPHER_WEP40 | IWINFO_CIPHER_WEP104;
+			}
+		}
+	}
+
+	return n;
+}
+
+static uint32_t iwinfo_scanlist_hash(const struct iwinfo_scanlist_entry *e,
+                                     uint32_t mask)
+{
+	return (iwinfo_machash(e->mac, mask) + e->mhz * 0x9e3779b1U) & mask;
+}
+
+/*
+ * Drop entries expanded from a Multiple BSSID element that duplicate
+ * another entry with the same BSSID on the same frequency, keeping the
+ * order. The same BSS reported on its own takes the place of the derived
+ * one. Entries the kernel reports more than once, on several channels or
+ * for a hidden SSID, are all kept. Returns the new length.
+ */
+int iwinfo_scanlist_dedup(char *buf, int len)
+{
+	struct iwinfo_scanlist_entry *e = (struct iwinfo_scanlist_entry *)buf, *f;
+	int i, n = len / sizeof(*e), count = 0;
+	uint32_t h, mask = 7;
+	int32_t *slots;
+	uint8_t *drop;
+
+	if (n < 2)
+		return len;
+
+	while (mask + 1 < (uint32_t)n * 2)
+		mask = (mask << 1) | 1;
+
+	if (!(drop = calloc(n, 1)))
+		return len;
+
+	/* slots hold entry index + 1 */
+	if (!(slots = calloc(mask + 1, sizeof(*slots))))
+	{
+		free(drop);
+		return len;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		for (h = iwinfo_scanlist_hash(&e[i], mask); slots[h];
+		     h = (h + 1) & mask)
+		{
+			f = &e[slots[h] - 1];
+
+			if (f->mhz != e[i].mhz || memcmp(f->mac, e[i].mac, 6) ||
+			    (!f->mbssid_derived && !e[i].mbssid_derived))
+				continue;
+
+			if (f->mbssid_derived && !e[i].mbssid_derived)
+				*f = e[i];
+
+			drop[i] = 1;
+			break;
+		}
+
+		if (!drop[i])
+			slots[h] = i + 1;
+	}
+
+	free(slots);
+
+	for (i = 0; i < n; i++)
+		if (!drop[i])
+			e[count++] = e[i];
+
+	free(drop);
+
+	return count * sizeof(*e);
+}
+
+int iwinfo_scan_filter_match(const struct iwinfo_scan_filter *f,
+                             const struct iwinfo_scanlist_entry *e)
+{
+	uint8_t kind;
+
+	if (f->bands && !(f->bands & e->band))
+		return 0;
+
+	if (f->channel && f->channel != e->channel)
+		return 0;
+
+	if (f->min_signal && (int8_t)e->signal < f->min_signal)
+		return 0;
+
+	if (f->ssid[0] && strcmp(f->ssid, e->ssid))
+		return 0;
+
+	if (f->crypto)
+	{
+		if (!e->crypto.enabled)
+			kind = IWINFO_SCAN_CRYPTO_OPEN;
+		else if (!e->crypto.wpa_version)
+			kind = IWINFO_SCAN_CRYPTO_WEP;
+		else
+			kind = (e->crypto.wpa_version & 7) << 2;
+
+		if (!(f->crypto & kind))
+			return 0;
+	}
+
+	return 1;
+}
+
+static void iwinfo_scanlist_swap(struct iwinfo_scanlist_entry *a,
+                                 struct iwinfo_scanlist_entry *b)
+{
+	struct iwinfo_scanlist_entry t = *a;
+
+	*a = *b;
+	*b = t;
+}
+
+/* min-heap on signal, the weakest of the kept BSSes sits at the root */
+static void iwinfo_scanlist_sift_up(struct iwinfo_scanlist_entry *h, int i)
+{
+	int p;
+
+	for (; i > 0; i = p)
+	{
+		p = (i - 1) / 2;
+
+		if ((int8_t)h[p].signal <= (int8_t)h[i].signal)
+			break;
+
+		iwinfo_scanlist_swap(&h[p], &h[i]);
+	}
+}
+
+static void iwinfo_scanlist_sift_down(struct iwinfo_scanlist_entry *h, int n,
+                                      int i)
+{
+	int c;
+
+	while ((c = 2 * i + 1) < n)
+	{
+		if (c + 1 < n && (int8_t)h[c + 1].signal < (int8_t)h[c].signal)
+			c++;
+
+		if ((int8_t)h[i].signal <= (int8_t)h[c].signal)
+			break;
+
+		iwinfo_scanlist_swap(&h[i], &h[c]);
+		i = c;
+	}
+}
+
+/* a kept entry that c duplicates in the sense of iwinfo_scanlist_dedup() */
+static int iwinfo_scanlist_find_dup(const struct iwinfo_scanlist_entry *list,
+                                    int n, const struct iwinfo_scanlist_entry *c)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		if (list[i].mhz == c->mhz && !memcmp(list[i].mac, c->mac, 6) &&
+		    (list[i].mbssid_derived || c->mbssid_derived))
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Take count candidates stored right behind the n entries of list. Entries
+ * not matching f are dropped, the others are moved up to close the gaps.
+ * With f->top set list is kept as a heap of at most top entries and a
+ * candidate only replaces the weakest one if it is stronger, so selecting
+ * costs O(log top) per BSS instead of sorting everything in the end.
+ * Multiple BSSID duplicates are resolved on the way in, as a dropped
+ * duplicate would otherwise leave the heap short of top entries.
+ * Returns the new number of entries in list.
+ */
+int iwinfo_scanlist_select(struct iwinfo_scanlist_entry *list, int n,
+                           const struct iwinfo_scan_filter *f, int count)
+{
+	struct iwinfo_scanlist_entry *c;
+	int i, d;
+
+	if (!f)
+		return n + count;
+
+	for (i = 0, c = list + n; i < count; i++, c++)
+	{
+		if (!iwinfo_scan_filter_match(f, c))
+			continue;
+
+		if (f->top && (d = iwinfo_scanlist_find_dup(list, n, c)) >= 0)
+		{
+			/* the BSS reported on its own replaces the derived one */
+			if (!c->mbssid_derived)
+			{
+				list[d] = *c;
+				iwinfo_scanlist_sift_up(list, d);
+				iwinfo_scanlist_sift_down(list, n, d);
+			}
+
+			continue;
+		}
+
+		if (!f->top || n < f->top)
+		{
+			if (c != &list[n])
+				list[n] = *c;
+
+			if (f->top)
+				iwinfo_scanlist_sift_up(list, n);
+
+			n++;
+		}
+		else if ((int8_t)c->signal > (int8_t)list[0].signal)
+		{
+			list[0] = *c;
+			iwinfo_scanlist_sift_down(list, n, 0);
+		}
+	}
+
+	return n;
+}
+
+static int iwinfo_scanlist_cmp_signal(const void *a, const void *b)
+{
+	const struct iwinfo_scanlist_entry *x = a, *y = b;
+
+	return (int8_t)y->signal - (int8_t)x->signal;
+}
+
+/* strongest first */
+void iwinfo_scanlist_sort(char *buf, int len)
+{
+	qsort(buf, len / sizeof(struct iwinfo_scanlist_entry),
+	      sizeof(struct iwinfo_scanlist_entry), iwinfo_scanlist_cmp_signal);
+}
+
+/* apply a filter to a complete scanlist, for results not filtered while
+ * parsing; returns the new length in bytes */
+int iwinfo_scanlist_filter(char *buf, int len,
+                           const struct iwinfo_scan_filter *f)
+{
+	struct iwinfo_scanlist_entry *e = (struct iwinfo_scanlist_entry *)buf;
+	int n = iwinfo_scanlist_select(e, 0, f, len / sizeof(*e));
+
+	len = n * sizeof(*e);
+
+	if (f->top)
+		iwinfo_scanlist_sort(buf, len);
+
+	return len;
+}
+
+static void iwinfo_ie_fill_he(const struct iwinfo_ie *ie,
+                              struct iwinfo_scanlist_he_chan_entry *he)
+{
+	uint32_t params = ie->data[0] | (ie->data[1] << 8) | (ie->data[2] << 16);
+	int off = 6;
+
+	he->present = 1;
+
+	/* BSS Color Information, bit 7 is BSS Color Disabled */
+	if (!(ie->data[3] & 0x80))
+		he->bss_color = ie->data[3] & 0x3f;
+
+	/* optional VHT Operation Information and Max Co-Hosted BSSID
+	 * Indicator precede the 6 GHz Operation Information */
+	if (params & (1 << 14))
+		off += 3;
+
+	if (params & (1 << 15))
+		off += 1;
+
+	if ((params & (1 << 17)) && ie->len >= off + 4)
+	{
+		he->primary_chan = ie->data[off];
+		he->chan_width = ie->data[off + 1] & 0x3;
+		he->center_chan_1 = ie->data[off + 2];
+		he->center_chan_2 = ie->data[off + 3];
+	}
+}
+
+/* copy the elements of a view into a scan result */
+void iwinfo_ie_fill(const struct iwinfo_ie_view *v,
+                    struct iwinfo_scanlist_entry *e)
+{
+	const struct iwinfo_ie *ie;
+	int len;
+
+	ie = iwinfo_ie_get(v, IWINFO_IE_SSID);
+
+	if (!ie || !ie->len)
+		ie = iwinfo_ie_get(v, IWINFO_IE_MESH_ID);
+
+	if (!e->ssid[0] && ie && ie->len)
+	{
+		len = (ie->len < IWINFO_ESSID_MAX_SIZE) ? ie->len : IWINFO_ESSID_MAX_SIZE;
+		memcpy(e->ssid, ie->data, len);
+		e->ssid[len] = 0;
+	}
+
+	if ((ie = iwinfo_ie_get(v, IWINFO_IE_RSN)) != NULL)
+		iwinfo_parse_rsn(&e->crypto, ie->data, ie->len,
+		                 IWINFO_CIPHER_CCMP, IWINFO_KMGMT_8021x);
+
+	if ((ie = iwinfo_ie_get(v, IWINFO_IE_WPA)) != NULL)
+		iwinfo_parse_rsn(&e->crypto, ie->data, ie->len,
+		                 IWINFO_CIPHER_TKIP, IWINFO_KMGMT_PSK);
+
+	if ((ie = iwinfo_ie_get(v, IWINFO_IE_HT_OP)) != NULL)
+	{
+		e->ht_chan_info.primary_chan = ie->data[0];
+		e->ht_chan_info.secondary_chan_off = ie->data[1] & 0x3;
+		e->ht_chan_info.chan_width = (ie->data[1] & 0x4) >> 2;
+	}
+
+	if ((ie = iwinfo_ie_get(v, IWINFO_IE_VHT_OP)) != NULL)
+	{
+		e->vht_chan_info.chan_width = ie->data[0];
+		e->vht_chan_info.center_chan_1 = ie->data[1];
+		e->vht_chan_info.center_chan_2 = ie->data[2];
+	}
+
+	if ((ie = iwinfo_ie_get(v, IWINFO_IE_MBSSID_INDEX)) != NULL)
+		e->mbssid_index = ie->data[0];
+
+	if ((ie = iwinfo_ie_get(v, IWINFO_IE_BSS_LOAD)) != NULL)
+	{
+		e->load.present = 1;
+		e->load.sta_count = ie->data[0] | (ie->data[1] << 8);
+		e->load.chan_util = ie->data[2];
+		e->load.admission_cap = ie->data[3] | (ie->data[4] << 8);
+	}
+
+	if ((ie = iwinfo_ie_get(v, IWINFO_IE_HE_OP)) != NULL)
+		iwinfo_ie_fill_he(ie, &e->he_chan_info);
+
+	if ((ie = iwinfo_ie_get(v, IWINFO_IE_EHT_OP)) != NULL)
+	{
+		e->eht_chan_info.present = 1;
+
+		/* EHT Operation Information follows the basic MCS and NSS set */
+		if ((ie->data[0] & 0x01) && ie->len >= 8)
+		{
+			e->eht_chan_info.chan_width = ie->data[5] & 0x7;
+			e->eht_chan_info.center_chan_1 = ie->data[6];
+			e->eht_chan_info.center_chan_2 = ie->data[7];
+
+			if ((ie->data[0] & 0x02) && ie->len >= 10)
+				e->eht_chan_info.disabled_subchans =
+					ie->data[8] | (ie->data[9] << 8);
+		}
+	}
+}
+
+int iwinfo_macindex_build(struct iwinfo_macindex *idx,
+                          const char *buf, int len, int size)
+{
+	int i, count;
+	uint32_t h, slots = 8;
+
+	memset(idx, 0, sizeof(*idx));
+
+	if (size < 6 || len < 0)
+		return -1;
+
+	count = len / size;
+
+	/* keep the load factor at or below 50% */
+	while (slots < (uint32_t)count * 2)
+		slots <<= 1;
+
+	idx->slots = calloc(slots, sizeof(*idx->slots));
+
+	if (!idx->slots)
+		return -1;
+
+	idx->buf  = buf;
+	idx->size = size;
+	idx->mask = slots - 1;
+
+	for (i = 0; i < count; i++)
+	{
+		h = iwinfo_machash((const uint8_t *)&buf[i * size], idx->mask);
+
+		/* slots hold entry number + 1, duplicates keep the first entry */
+		while (idx->slots[h] &&
+		       memcmp(&buf[(idx->slots[h] - 1) * size], &buf[i * size], 6))
+			h = (h + 1) & idx->mask;
+
+		if (!idx->slots[h])
+			idx->slots[h] = i + 1;
+	}
+
+	return 0;
+}
+
+void * iwinfo_macindex_lookup(const struct iwinfo_macindex *idx,
+                              const uint8_t *mac)
+{
+	const char *e;
+	uint32_t h;
+
+	if (!idx->slots)
+		return NULL;
+
+	for (h = iwinfo_machash(mac, idx->mask); idx->slots[h];
+	     h = (h + 1) & idx->mask)
+	{
+		e = &idx->buf[(idx->slots[h] - 1) * idx->size];
+
+		if (!memcmp(e, mac, 6))
+			return (void *)e;
+	}
+
+	return NULL;
+}
+
+void iwinfo_macindex_free(struct iwinfo_macindex *idx)
+{
+	free(idx->slots);
+	memset(idx, 0, sizeof(*idx));
+}
@@ -65,7 +65,7 @@ static int wext_probe(const char *ifname)
 
 static void wext_close(void)
 {
-	/* Nop */
+	wext_scan_close();
 }
 
 static int wext_get_mode(const char *ifname, int *buf)
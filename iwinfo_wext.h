@@ -377,6 +377,14 @@ static const unsigned int standard_event_num =
 #define	IW_IE_CYPHER_NUM	8
 #define	IW_IE_KEY_MGMT_NUM	3
 
+/* scan completion wait in ms, polling is a fallback for missing events */
+#define WEXT_SCAN_TIMEOUT	15000
+#define WEXT_SCAN_POLL_FIRST	250
+#define WEXT_SCAN_POLL		100
+#define WEXT_SCAN_POLL_EVENT	1000
+
+int wext_scan(const char *ifname, char *buf, int *len, uint32_t poll_ms);
 int wext_get_scanlist(const char *ifname, char *buf, int *len);
+void wext_scan_close(void);
 
 #endif
@@ -22,6 +22,8 @@
 #include "iwinfo.h"
 #include "iwinfo_wext.h"
 
+#include <linux/rtnetlink.h>
+
 
 static int wext_ioctl(const char *ifname, int cmd, struct iwreq *wrq)
 {
@@ -213,37 +215,12 @@ static inline int wext_extract_event(struct stream_descr *stream, struct iw_even
 	return 1;
 }
 
-static inline void wext_fill_wpa(unsigned char *iebuf, int ielen, struct iwinfo_scanlist_entry *e)
-{
-	static unsigned char ms_oui[3] = { 0x00, 0x50, 0xf2 };
-
-	while (ielen >= 2 && ielen >= iebuf[1])
-	{
-		switch (iebuf[0])
-		{
-		case 48: /* RSN */
-			iwinfo_parse_rsn(&e->crypto, iebuf + 2, iebuf[1],
-			                 IWINFO_CIPHER_CCMP, IWINFO_KMGMT_8021x);
-			break;
-
-		case 221: /* Vendor */
-			if (iebuf[1] >= 4 && !memcmp(iebuf + 2, ms_oui, 3) && iebuf[5] == 1)
-				iwinfo_parse_rsn(&e->crypto, iebuf + 6, iebuf[1] - 4,
-				                 IWINFO_CIPHER_TKIP, IWINFO_KMGMT_PSK);
-			break;
-		}
-
-		ielen -= iebuf[1] + 2;
-		iebuf += iebuf[1] + 2;
-	}
-}
-
-
 static inline void wext_fill_entry(struct stream_descr *stream, struct iw_event *event,
 	struct iw_range *iw_range, int has_range, struct iwinfo_scanlist_entry *e)
 {
 	int i;
 	double freq;
+	struct iwinfo_ie_view ies;
 
 	/* Now, let's decode the event */
 	switch(event->cmd)
@@ -330,22 +307,167 @@ static inline void wext_fill_entry(struct stream_descr *stream, struct iw_event
 			break;
 #endif
 		 case IWEVGENIE:
-			wext_fill_wpa(event->u.data.pointer, event->u.data.length, e);
+			iwinfo_ie_parse(event->u.data.pointer, event->u.data.length, &ies);
+			iwinfo_ie_fill(&ies, e);
 			break;
 	}
 }
 
 
-int wext_get_scanlist(const char *ifname, char *buf, int *len)
+/* results of the last scan, kept at the size the driver needed */
+static unsigned char *wext_scan_buf = NULL;
+static int wext_scan_buflen = IW_SCAN_MAX_DATA; /* Min for compat WE<17 */
+
+void wext_scan_close(void)
+{
+	free(wext_scan_buf);
+
+	wext_scan_buf = NULL;
+	wext_scan_buflen = IW_SCAN_MAX_DATA;
+}
+
+/*
+ * Drivers announce a finished scan with a SIOCGIWSCAN wireless event,
+ * carried as IFLA_WIRELESS in RTM_NEWLINK. Subscribe before triggering
+ * the scan so the event cannot be missed.
+ */
+static int wext_scan_event_open(void)
+{
+	struct sockaddr_nl sa = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = RTMGRP_LINK
+	};
+	int sock;
+
+	sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+	              NETLINK_ROUTE);
+
+	if (sock < 0)
+		return -1;
+
+	if (bind(sock, (struct sockaddr *)&sa, sizeof(sa)))
+	{
+		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+/* drain the socket, 1 if the scan of ifindex completed */
+static int wext_scan_event_recv(int sock, int ifindex)
+{
+	char msg[8192];
+	struct nlmsghdr *hdr;
+	struct ifinfomsg *ifi;
+	struct rtattr *rta;
+	uint16_t ev[2];	/* packed iw_event header, len and cmd */
+	int len, alen, off, done = 0;
+
+	while ((len = recv(sock, msg, sizeof(msg), 0)) > 0)
+	{
+		for (hdr = (struct nlmsghdr *)msg; NLMSG_OK(hdr, len);
+		     hdr = NLMSG_NEXT(hdr, len))
+		{
+			if (hdr->nlmsg_type != RTM_NEWLINK)
+				continue;
+
+			ifi = NLMSG_DATA(hdr);
+
+			if (ifi->ifi_index != ifindex)
+				continue;
+
+			alen = IFLA_PAYLOAD(hdr);
+
+			for (rta = IFLA_RTA(ifi); RTA_OK(rta, alen);
+			     rta = RTA_NEXT(rta, alen))
+			{
+				if (rta->rta_type != IFLA_WIRELESS)
+					continue;
+
+				for (off = 0; off + sizeof(ev) <= RTA_PAYLOAD(rta); off += ev[0])
+				{
+					memcpy(ev, (char *)RTA_DATA(rta) + off, sizeof(ev));
+
+					if (ev[1] == SIOCGIWSCAN)
+						done = 1;
+
+					if (ev[0] < sizeof(ev))
+						break;
+				}
+			}
+		}
+	}
+
+	/* events were dropped, one of them may have been ours */
+	if (len < 0 && errno == ENOBUFS)
+		done = 1;
+
+	return done;
+}
+
+static int wext_scan_fetch(const char *ifname, const struct iw_range *range,
+                           struct iwreq *wrq)
+{
+	unsigned char *newbuf;
+
+	while (1)
+	{
+		if (!wext_scan_buf && !(wext_scan_buf = malloc(wext_scan_buflen)))
+			return -1;
+
+		wrq->u.data.pointer = wext_scan_buf;
+		wrq->u.data.flags   = 0;
+		wrq->u.data.length  = wext_scan_buflen;
+
+		if (!wext_ioctl(ifname, SIOCGIWSCAN, wrq))
+			return 0;
+
+		/* Check if buffer was too small (WE-17 only) */
+		if ((errno != E2BIG) || (range->we_version_compiled <= 16) ||
+		    (wext_scan_buflen >= 0xFFFF))
+			return -1;
+
+		/* Some driver may return very large scan results, either
+		 * because there are many cells, or because they have many
+		 * large elements in cells (like IWEVCUSTOM). Most will
+		 * only need the regular sized buffer. We now use a dynamic
+		 * allocation of the buffer to satisfy everybody. Of course,
+		 * as we don't know in advance the size of the array, we try
+		 * various increasing sizes. Jean II */
+
+		/* Check if the driver gave us any hints. */
+		if (wrq->u.data.length > wext_scan_buflen)
+			wext_scan_buflen = wrq->u.data.length;
+		else
+			wext_scan_buflen *= 2;
+
+		/* the length field of iw_point is 16 bit */
+		if (wext_scan_buflen > 0xFFFF)
+			wext_scan_buflen = 0xFFFF;
+
+		if (!(newbuf = realloc(wext_scan_buf, wext_scan_buflen)))
+		{
+			wext_scan_close();
+			return -1;
+		}
+
+		wext_scan_buf = newbuf;
+	}
+}
+
+/*
+ * Scan and wait for the completion event. Without an event the results
+ * are probed every poll_ms, 0 waits for the event up to the deadline, for
+ * drivers which return stale results while scanning.
+ */
+int wext_scan(const char *ifname, char *buf, int *len, uint32_t poll_ms)
 {
 	struct iwreq wrq;
-	struct iw_scan_req scanopt;        /* Options for 'set' */
-	unsigned char *buffer = NULL;      /* Results */
-	int buflen = IW_SCAN_MAX_DATA; /* Min for compat WE<17 */
 	struct iw_range range;
 	int has_range = 1;
-	struct timeval tv;             /* Select timeout */
-	int timeout = 15000000;     /* 15s */
+	int sock, ifindex, ret;
+	uint64_t deadline, next;
 
 	int entrylen = 0;
 	struct iwinfo_scanlist_entry e;
@@ -354,174 +476,129 @@ int wext_get_scanlist(const char *ifname, char *buf, int *len)
 	wrq.u.data.length  = sizeof(struct iw_range);
 	wrq.u.data.flags   = 0;
 
-	if( wext_ioctl(ifname, SIOCGIWRANGE, &wrq) >= 0 )
-	{
-		/* Init timeout value -> 250ms between set and first get */
-		tv.tv_sec  = 0;
-		tv.tv_usec = 250000;
-
-		/* Clean up set args */
-		memset(&scanopt, 0, sizeof(scanopt));
+	if( wext_ioctl(ifname, SIOCGIWRANGE, &wrq) < 0 )
+		return -1;
 
-		wrq.u.data.pointer = NULL;
-		wrq.u.data.flags   = 0;
-		wrq.u.data.length  = 0;
+	sock = wext_scan_event_open();
+	ifindex = if_nametoindex(ifname);
 
-		/* Initiate Scanning */
-		if( wext_ioctl(ifname, SIOCSIWSCAN, &wrq) >= 0 )
-		{
-			timeout -= tv.tv_usec;
+	wrq.u.data.pointer = NULL;
+	wrq.u.data.flags   = 0;
+	wrq.u.data.length  = 0;
 
-			/* Forever */
-			while(1)
-			{
-				fd_set rfds;       /* File descriptors for select */
-				int last_fd;    /* Last fd */
-				int ret;
+	/* Initiate Scanning, a scan already in progress will do as well */
+	if( (wext_ioctl(ifname, SIOCSIWSCAN, &wrq) < 0) && (errno != EBUSY) )
+	{
+		if (sock >= 0)
+			close(sock);
 
-				/* Guess what ? We must re-generate rfds each time */
-				FD_ZERO(&rfds);
-				last_fd = -1;
-				/* In here, add the rtnetlink fd in the list */
+		return -1;
+	}
 
-				/* Wait until something happens */
-				ret = select(last_fd + 1, &rfds, NULL, NULL, &tv);
+	deadline = iwinfo_msec() + WEXT_SCAN_TIMEOUT;
 
-				/* Check if there was an error */
-				if(ret < 0)
-				{
-					if(errno == EAGAIN || errno == EINTR)
-						continue;
+	if (sock < 0)
+		next = iwinfo_msec() + WEXT_SCAN_POLL_FIRST;
+	else
+		next = poll_ms ? iwinfo_msec() + poll_ms : deadline;
+
+	/*
+	 * Wait for the completion event. Results are polled for only when
+	 * none arrives in time, for drivers which do not send it or when
+	 * the event socket is not available.
+	 */
+	while (1)
+	{
+		ret = iwinfo_wait_fd(sock, (next < deadline) ? next : deadline);
 
-					return -1;
-				}
+		if (ret > 0)
+		{
+			if (!wext_scan_event_recv(sock, ifindex))
+				continue;
+		}
+		else
+		{
+			if (ret < 0)
+			{
+				close(sock);
+				sock = -1;
+			}
 
-				/* Check if there was a timeout */
-				if(ret == 0)
-				{
-					unsigned char *newbuf;
+			if (sock < 0)
+				next = iwinfo_msec() + WEXT_SCAN_POLL;
+			else
+				next = poll_ms ? iwinfo_msec() + poll_ms : deadline;
+		}
 
-		realloc:
-					/* (Re)allocate the buffer - realloc(NULL, len) == malloc(len) */
-					newbuf = realloc(buffer, buflen);
-					if(newbuf == NULL)
-					{
-						if(buffer)
-							free(buffer);
+		if( !wext_scan_fetch(ifname, &range, &wrq) )
+			break;
 
-						return -1;
-					}
+		/* Check if results not available yet */
+		if( (errno != EAGAIN) || (iwinfo_msec() >= deadline) )
+		{
+			if (sock >= 0)
+				close(sock);
 
-					buffer = newbuf;
+			return -1;
+		}
+	}
 
-					/* Try to read the results */
-					wrq.u.data.pointer = buffer;
-					wrq.u.data.flags   = 0;
-					wrq.u.data.length  = buflen;
+	if (sock >= 0)
+		close(sock);
 
-					if( wext_ioctl(ifname, SIOCGIWSCAN, &wrq) )
-					{
-						/* Check if buffer was too small (WE-17 only) */
-						if((errno == E2BIG) && (range.we_version_compiled > 16))
-						{
-							/* Some driver may return very large scan results, either
-							 * because there are many cells, or because they have many
-							 * large elements in cells (like IWEVCUSTOM). Most will
-							 * only need the regular sized buffer. We now use a dynamic
-							 * allocation of the buffer to satisfy everybody. Of course,
-							 * as we don't know in advance the size of the array, we try
-							 * various increasing sizes. Jean II */
-
-							/* Check if the driver gave us any hints. */
-							if(wrq.u.data.length > buflen)
-								buflen = wrq.u.data.length;
-							else
-								buflen *= 2;
-
-							/* Try again */
-							goto realloc;
-						}
-
-						/* Check if results not available yet */
-						if(errno == EAGAIN)
-						{
-							/* Restart timer for only 100ms*/
-							tv.tv_sec = 0;
-							tv.tv_usec = 100000;
-							timeout -= tv.tv_usec;
-
-							if(timeout > 0)
-								continue;   /* Try again later */
-						}
-
-						/* Bad error */
-						free(buffer);
-						return -1;
-
-					} else {
-						/* We have the results, go to process them */
-						break;
-					}
-				}
-			}
+	if( wrq.u.data.length )
+	{
+		struct iw_event       iwe;
+		struct stream_descr   stream;
+		int first = 1;
 
-			if( wrq.u.data.length )
-			{
-				struct iw_event       iwe;
-				struct stream_descr   stream;
-				int ret;
-				int first = 1;
+		memset(&e, 0, sizeof(e));
+		memset(&stream, 0, sizeof(stream));
+		stream.current = (char *)wext_scan_buf;
+		stream.end     = (char *)wext_scan_buf + wrq.u.data.length;
 
-				memset(&stream, 0, sizeof(stream));
-				stream.current = (char *)buffer;
-				stream.end     = (char *)buffer + wrq.u.data.length;
+		do
+		{
+			/* Extract an event and print it */
+			ret = wext_extract_event(&stream, &iwe, range.we_version_compiled);
 
-				do
+			if(ret >= 0)
+			{
+				if( (iwe.cmd == SIOCGIWAP) || (ret == 0) )
 				{
-					/* Extract an event and print it */
-					ret = wext_extract_event(&stream, &iwe, range.we_version_compiled);
+					if( first )
+					{
+						first = 0;
+					}
+					else if( (entrylen + sizeof(struct iwinfo_scanlist_entry)) <= IWINFO_BUFSIZE )
+					{
+						/* if encryption is off, clear the crypto strunct */
+						if( !e.crypto.enabled )
+							memset(&e.crypto, 0, sizeof(struct iwinfo_crypto_entry));
 
-					if(ret >= 0)
+						memcpy(&buf[entrylen], &e, sizeof(struct iwinfo_scanlist_entry));
+						entrylen += sizeof(struct iwinfo_scanlist_entry);
+					}
+					else
 					{
-						if( (iwe.cmd == SIOCGIWAP) || (ret == 0) )
-						{
-							if( first )
-							{
-								first = 0;
-							}
-							else if( (entrylen + sizeof(struct iwinfo_scanlist_entry)) <= IWINFO_BUFSIZE )
-							{
-								/* if encryption is off, clear the crypto strunct */
-								if( !e.crypto.enabled )
-									memset(&e.crypto, 0, sizeof(struct iwinfo_crypto_entry));
-
-								memcpy(&buf[entrylen], &e, sizeof(struct iwinfo_scanlist_entry));
-								entrylen += sizeof(struct iwinfo_scanlist_entry);
-							}
-							else
-							{
-								/* we exceed the callers buffer size, abort here ... */
-								break;
-							}
-
-							memset(&e, 0, sizeof(struct iwinfo_scanlist_entry));
-						}
-
-						wext_fill_entry(&stream, &iwe, &range, has_range, &e);
+						/* we exceed the callers buffer size, abort here ... */
+						break;
 					}
 
-				} while(ret > 0);
+					memset(&e, 0, sizeof(struct iwinfo_scanlist_entry));
+				}
 
-				free(buffer);
-				*len = entrylen;
-				return 0;
+				wext_fill_entry(&stream, &iwe, &range, has_range, &e);
 			}
 
-			*len = 0;
-			free(buffer);
-			return 0;
-		}
+		} while(ret > 0);
 	}
 
-	return -1;
+	*len = entrylen;
+	return 0;
+}
+
+int wext_get_scanlist(const char *ifname, char *buf, int *len)
+{
+	return wext_scan(ifname, buf, len, WEXT_SCAN_POLL_EVENT);
 }
@@ -471,6 +471,7 @@ static int wl_get_assoclist(const char *ifname, char *buf, int *len)
 
 			entry.noise = noise;
 			memcpy(entry.mac, &macs->ea[i], 6);
+			strncpy(entry.ifname, ifname, sizeof(entry.ifname) - 1);
 			wl_get_assoclist_cb(ifname, &entry);
 
 			memcpy(&buf[j], &entry, sizeof(entry));